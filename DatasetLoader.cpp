@@ -9,6 +9,8 @@
 
 #include "DatasetLoader.h"
 #include "VectorField.h"
+#include "fieldloader.h"
+#include "GlobalProgressBar.h"
 #include <QtGui/QFileDialog>
 #include <QtGui/QMessageBox>
 
@@ -61,10 +63,47 @@ DatasetLoader::DatasetLoader(QString name,QWidget *parent):DockWidget(name,paren
 	
 	dataPresetHorizontalLayout->addWidget(loadPresetPushButton);
 	
+	cancelLoadPushButton = new QPushButton(dataGroupBox);
+	cancelLoadPushButton->setObjectName(QString::fromUtf8("cancelLoadPushButton"));
+	cancelLoadPushButton->setEnabled(false);
+	
+	dataPresetHorizontalLayout->addWidget(cancelLoadPushButton);
+	
+	saveContainerPushButton = new QPushButton(dataGroupBox);
+	saveContainerPushButton->setObjectName(QString::fromUtf8("saveContainerPushButton"));
+	
+	dataPresetHorizontalLayout->addWidget(saveContainerPushButton);
+	
 	
 	
 	scrollAreaVerticalLayout->addWidget(dataGroupBox);
 	
+	storageGroupBox = new QGroupBox(datasetScrollAreaWidgetContents);
+	storageGroupBox->setObjectName(QString::fromUtf8("storageGroupBox"));
+	storageGroupBox->setSizePolicy(sizePolicy);
+	storageHorizontalLayout = new QHBoxLayout(storageGroupBox);
+	storageHorizontalLayout->setObjectName(QString::fromUtf8("storageHorizontalLayout"));
+	storageLayoutComboBox = new QComboBox(storageGroupBox);
+	storageLayoutComboBox->setObjectName(QString::fromUtf8("storageLayoutComboBox"));
+	storageLayoutComboBox->setSizePolicy(sizePolicy1);
+	
+	storageHorizontalLayout->addWidget(storageLayoutComboBox);
+	
+	cacheBudgetLabel = new QLabel(storageGroupBox);
+	cacheBudgetLabel->setObjectName(QString::fromUtf8("cacheBudgetLabel"));
+	
+	storageHorizontalLayout->addWidget(cacheBudgetLabel);
+	
+	cacheBudgetSpinBox = new QSpinBox(storageGroupBox);
+	cacheBudgetSpinBox->setObjectName(QString::fromUtf8("cacheBudgetSpinBox"));
+	cacheBudgetSpinBox->setMinimum(1);
+	cacheBudgetSpinBox->setMaximum(65536);
+	cacheBudgetSpinBox->setValue(256);
+	
+	storageHorizontalLayout->addWidget(cacheBudgetSpinBox);
+	
+	scrollAreaVerticalLayout->addWidget(storageGroupBox);
+	
 	openDataGroupBox = new QGroupBox(datasetScrollAreaWidgetContents);
 	openDataGroupBox->setObjectName(QString::fromUtf8("openDataGroupBox"));
 	openDataGridLayout = new QGridLayout(openDataGroupBox);
@@ -150,6 +189,18 @@ DatasetLoader::DatasetLoader(QString name,QWidget *parent):DockWidget(name,paren
 	presetComboBox->clear();
 
 	loadPresetPushButton->setText(QApplication::translate("DatasetLoader", " Load ", 0, QApplication::UnicodeUTF8));
+	cancelLoadPushButton->setText(QApplication::translate("DatasetLoader", " Cancel ", 0, QApplication::UnicodeUTF8));
+	saveContainerPushButton->setText(QApplication::translate("DatasetLoader", " Save .vfc ", 0, QApplication::UnicodeUTF8));
+	storageGroupBox->setTitle(QApplication::translate("DatasetLoader", "Storage Layout:", 0, QApplication::UnicodeUTF8));
+	storageLayoutComboBox->clear();
+	storageLayoutComboBox->insertItems(0, QStringList()
+	 << QApplication::translate("DatasetLoader", "Linear", 0, QApplication::UnicodeUTF8)
+	 << QApplication::translate("DatasetLoader", "Bricked (Z-order)", 0, QApplication::UnicodeUTF8)
+	 << QApplication::translate("DatasetLoader", "Half Float (fp16)", 0, QApplication::UnicodeUTF8)
+	 << QApplication::translate("DatasetLoader", "Quantized 16 bit", 0, QApplication::UnicodeUTF8)
+	 << QApplication::translate("DatasetLoader", "Out-of-core Bricks", 0, QApplication::UnicodeUTF8)
+	);
+	cacheBudgetLabel->setText(QApplication::translate("DatasetLoader", "Cache MB:", 0, QApplication::UnicodeUTF8));
 	openDataGroupBox->setTitle(QApplication::translate("DatasetLoader", "Open a Dataset:", 0, QApplication::UnicodeUTF8));
 	dataDimensionXLabel->setText(QApplication::translate("DatasetLoader", "X:", 0, QApplication::UnicodeUTF8));
 	dataDimensionYLabel->setText(QApplication::translate("DatasetLoader", "Y:", 0, QApplication::UnicodeUTF8));
@@ -160,8 +211,16 @@ DatasetLoader::DatasetLoader(QString name,QWidget *parent):DockWidget(name,paren
 
         connect(openDatasetPushButton,SIGNAL(clicked()),this,SLOT(onDataOpen()));
         connect(loadPresetPushButton,SIGNAL(clicked()),this,SLOT(onLoadPreset()));
+        connect(saveContainerPushButton,SIGNAL(clicked()),this,SLOT(onSaveContainer()));
         connect(&VectorField::getSingleton(),SIGNAL(dataUpdated()),this,SLOT(onDataLoaded()));
 
+        fieldLoader=new FieldLoader(this);
+
+        connect(fieldLoader,SIGNAL(progress(int)),this,SLOT(onLoadProgress(int)));
+        connect(fieldLoader,SIGNAL(loaded()),this,SLOT(onLoadStopped()));
+        connect(fieldLoader,SIGNAL(cancelled()),this,SLOT(onLoadStopped()));
+        connect(cancelLoadPushButton,SIGNAL(clicked()),fieldLoader,SLOT(cancel()));
+
         preparePresets();
 }
 
@@ -174,8 +233,29 @@ void DatasetLoader::onDataLoaded()
 {
 
 
-    dataInfoPlainTextEdit->setPlainText( QString("Dataset: %1\nData Dimension: %2x%3x%4\nMinimum Magnitude: %5\nMaximum Magnitude:%6").arg( VectorField::getSingleton().getDataName() ).arg(VectorField::getSingleton().xSize).arg(VectorField::getSingleton().ySize).arg(VectorField::getSingleton().zSize).arg(VectorField::getSingleton().minMag).arg(VectorField::getSingleton().maxMag));
+    dataInfoPlainTextEdit->setPlainText( QString("Dataset: %1\nData Dimension: %2x%3x%4\nMinimum Magnitude: %5\nMaximum Magnitude:%6\nStorage: %7").arg( VectorField::getSingleton().getDataName() ).arg(VectorField::getSingleton().xSize).arg(VectorField::getSingleton().ySize).arg(VectorField::getSingleton().zSize).arg(VectorField::getSingleton().minMag).arg(VectorField::getSingleton().maxMag).arg(VectorField::getSingleton().getStorageInfo()));
 
+    for(int i=1;i<VectorField::getSingleton().getLevelCount();++i)
+    {
+        int x,y,z;
+        VectorField::getSingleton().getLevelSize(i,x,y,z);
+        dataInfoPlainTextEdit->appendPlainText(QString("Level %1: %2x%3x%4").arg(i).arg(x).arg(y).arg(z));
+    }
+
+}
+
+void DatasetLoader::onLoadProgress(int percent)
+{
+    if(globalProgressBar)
+        globalProgressBar->setValue(percent);
+}
+
+void DatasetLoader::onLoadStopped()
+{
+    cancelLoadPushButton->setEnabled(false);
+
+    if(globalProgressBar)
+        globalProgressBar->setValue(0);
 }
 
 bool DatasetLoader::parseVolumeAttribute(VolumeData * vd, QByteArray attr, QByteArray value) {
@@ -216,6 +296,7 @@ bool DatasetLoader::parseVolumeAttribute(VolumeData * vd, QByteArray attr, QByte
                 return true;
         }
         else if (attr == "format") {
+                vd->ifformat = true;
                 if (value == "UNSIGNED_8BIT") { vd->format = UNSIGNED_8BIT; return true; }
                 else if (value == "SIGNED_8BIT") { vd->format = SIGNED_8BIT; return true; }
                 else if (value == "UNSIGNED_16BIT") { vd->format = UNSIGNED_16BIT; return true; }
@@ -227,6 +308,7 @@ bool DatasetLoader::parseVolumeAttribute(VolumeData * vd, QByteArray attr, QByte
                 else return false;
         }
         else if (attr == "byteorder") {
+                vd->ifbyteorder = true;
                 if (value == "BIGENDIAN") { vd->byteorder = BIGENDIAN; return true; }
                 else if (value == "LITTEENDIAN") { vd->byteorder = LITTEENDIAN; return true; }
                 else return false;
@@ -266,10 +348,52 @@ void DatasetLoader::   onLoadPreset()
     if (fileName.length()>0)
     {
             setWindowTitle(QString("3DTest - opened file:%1").arg(fileName));
-            VectorField::getSingleton().init(fileName.toStdString().c_str(), vd->dim.X(), vd->dim.Y(), vd->dim.Z(),dataname);
+            applyStorageLayout();
+            applySourceFormat(vd);
+
+            cancelLoadPushButton->setEnabled(true);
+
+            if(vd->totalstep>1)
+                fieldLoader->loadSeries(fileName, vd->startstep, vd->totalstep, vd->dim.X(), vd->dim.Y(), vd->dim.Z(),dataname);
+            else
+                fieldLoader->load(fileName, vd->dim.X(), vd->dim.Y(), vd->dim.Z(),dataname);
     }
 }
 
+void DatasetLoader::applyStorageLayout()
+{
+    VectorField::getSingleton().setStorageLayout((VectorField::StorageLayout)storageLayoutComboBox->currentIndex());
+    VectorField::getSingleton().setBrickCacheBudget(cacheBudgetSpinBox->value());
+}
+
+void DatasetLoader::applySourceFormat(VolumeData *vd)
+{
+    //a preset that declares nothing, and any file opened by hand, is a native float .vec
+    FieldFormat format;
+
+    if(vd)
+    {
+        if(vd->ifformat)
+        {
+            static const FieldFormat::ElementType types[]={FieldFormat::UInt8, FieldFormat::Int8,
+                                                           FieldFormat::UInt16, FieldFormat::Int16,
+                                                           FieldFormat::UInt32, FieldFormat::Int32,
+                                                           FieldFormat::Float32, FieldFormat::Float64};
+            format.type=types[vd->format];
+        }
+
+        if(vd->ifbyteorder)
+            format.bigEndian=(vd->byteorder==BIGENDIAN);
+
+        format.clampMin=vd->ifclampminval;
+        format.minValue=vd->clampminval;
+        format.clampMax=vd->ifclampmaxval;
+        format.maxValue=vd->clampmaxval;
+    }
+
+    VectorField::getSingleton().setSourceFormat(format);
+}
+
 void DatasetLoader::parsePresets(const char * datafile)
 {
 
@@ -328,11 +452,40 @@ void DatasetLoader::parsePresets(const char * datafile)
 
 void DatasetLoader::onDataOpen()
 {
-    QString fileName = QFileDialog::getOpenFileName(this,tr("Open Vector Field"), "./", tr("Vector Field File (*.vec)"));
+    QString fileName = QFileDialog::getOpenFileName(this,tr("Open Vector Field"), "./", tr("Vector Field File (*.vec *.vfc)"));
 
     if (fileName.length()>0)
     {
+            //a container brings its own dimensions
+            int x,y,z;
+
+            if(VectorField::getContainerSize(fileName.toLocal8Bit().constData(),x,y,z))
+            {
+                dataDimensionXSpinBox->setValue(x);
+                dataDimensionYSpinBox->setValue(y);
+                dataDimensionZSpinBox->setValue(z);
+            }
+
             setWindowTitle(QString("3DTest - opened file:%1").arg(fileName));
-            VectorField::getSingleton().init(fileName.toStdString().c_str(), dataDimensionXSpinBox->value(), dataDimensionYSpinBox->value(), dataDimensionZSpinBox->value(),fileName);
+            applyStorageLayout();
+            applySourceFormat(NULL);
+            cancelLoadPushButton->setEnabled(true);
+            fieldLoader->load(fileName, dataDimensionXSpinBox->value(), dataDimensionYSpinBox->value(), dataDimensionZSpinBox->value(),fileName);
+    }
+}
+
+void DatasetLoader::onSaveContainer()
+{
+    if(VectorField::getSingleton().xSize==0)
+        return;
+
+    //the loaded field is converted as it is, so a preset in any format becomes a native container
+    QString fileName = QFileDialog::getSaveFileName(this,tr("Save Field Container"), "./", tr("Vector Field Container (*.vfc)"));
+
+    if (fileName.length()>0 && !VectorField::getSingleton().saveContainer(fileName))
+    {
+        QMessageBox msgBox;
+        msgBox.setText(QString("Cannot write %1").arg(fileName));
+        msgBox.exec();
     }
 }
@@ -31,6 +31,8 @@
 #include "Point3.h"
 #include "DockWidget.h"
 
+class FieldLoader;
+
 
 class DatasetLoader :public DockWidget
 {
@@ -58,6 +60,8 @@ private:
                          clampminval = -1e+20;
                          ifclampmaxval = false;
                          ifclampminval = false;
+                         ifformat = false;
+                         ifbyteorder = false;
                  }
                  ~VolumeData() {
                          if (name) delete [] name;
@@ -71,6 +75,7 @@ private:
                  int startstep;
                  double clampmaxval, clampminval;
                  bool   ifclampmaxval, ifclampminval;
+                 bool   ifformat, ifbyteorder;
                  GGL::Point3f dim;
                  MESHATT format;
                  BYTEORDER byteorder;
@@ -88,6 +93,13 @@ private:
     QHBoxLayout *dataPresetHorizontalLayout;
     QComboBox *presetComboBox;
     QPushButton *loadPresetPushButton;
+    QPushButton *cancelLoadPushButton;
+    QPushButton *saveContainerPushButton;
+    QGroupBox *storageGroupBox;
+    QHBoxLayout *storageHorizontalLayout;
+    QComboBox *storageLayoutComboBox;
+    QLabel *cacheBudgetLabel;
+    QSpinBox *cacheBudgetSpinBox;
     QGroupBox *openDataGroupBox;
     QGridLayout *openDataGridLayout;
     QLabel *dataDimensionXLabel;
@@ -99,6 +111,8 @@ private:
     QPushButton *openDatasetPushButton;
     QLabel *dimensionLabel;
     QSpacerItem *dataLoaderVerticalSpacer;
+
+    FieldLoader *fieldLoader;
 	
 public:
 	DatasetLoader(QString name,QWidget *parent);
@@ -108,11 +122,16 @@ public:
        void  onDataOpen();
        void onLoadPreset();
        void onDataLoaded();
+       void onLoadProgress(int percent);
+       void onLoadStopped();
+       void onSaveContainer();
 	
 private:
     void parsePresets(const char * datafile);
     void preparePresets();
     bool parseVolumeAttribute(VolumeData * vd, QByteArray attr, QByteArray value) ;
+    void applyStorageLayout();
+    void applySourceFormat(VolumeData *vd);
 }; 
 
 #endif
@@ -8,6 +8,10 @@
  */
 
 #include "DownSampler.h"
+#include "VectorField.h"
+#include <stdio.h>
+#include <vector>
+#include <QtGui/QFileDialog>
 
 DownSampler::DownSampler(QString name,QWidget *parent):DockWidget(name,parent)
 {
@@ -86,6 +90,83 @@ DownSampler::DownSampler(QString name,QWidget *parent):DockWidget(name,parent)
 	downSampleDimensionLabel->setText(QApplication::translate("DownSampler", "Down Sample Dimension:", 0, QApplication::UnicodeUTF8));
 	
 	QMetaObject::connectSlotsByName(this);
+	
+	connect(savePushButton,SIGNAL(clicked()),this,SLOT(onSave()));
+	connect(&VectorField::getSingleton(),SIGNAL(dataUpdated()),this,SLOT(onDataUpdated()));
+}
+
+void DownSampler::onDataUpdated()
+{
+	VectorField &field=VectorField::getSingleton();
+	
+	downSampleDimensionXSpinBox->setRange(2,field.xSize);
+	downSampleDimensionYSpinBox->setRange(2,field.ySize);
+	downSampleDimensionZSpinBox->setRange(2,field.zSize);
+	
+	downSampleDimensionXSpinBox->setValue(qMax(2,(field.xSize+1)/2));
+	downSampleDimensionYSpinBox->setValue(qMax(2,(field.ySize+1)/2));
+	downSampleDimensionZSpinBox->setValue(qMax(2,(field.zSize+1)/2));
+}
+
+void DownSampler::onSave()
+{
+	VectorField &field=VectorField::getSingleton();
+	
+	if(field.xSize<2 || field.ySize<2 || field.zSize<2)
+		return;
+	
+	QString fileName = QFileDialog::getSaveFileName(this,tr("Save Down-Sampled Vector Field"), "./", tr("Vector Field File (*.vec)"));
+	
+	if(fileName.isEmpty())
+		return;
+	
+	int targetX=downSampleDimensionXSpinBox->value();
+	int targetY=downSampleDimensionYSpinBox->value();
+	int targetZ=downSampleDimensionZSpinBox->value();
+	
+	//resample the coarsest pyramid level that still has at least the requested resolution
+	int level=0;
+	
+	for(int i=1;i<field.getLevelCount();++i)
+	{
+		int x,y,z;
+		field.getLevelSize(i,x,y,z);
+		
+		if(x<targetX || y<targetY || z<targetZ)
+			break;
+		
+		level=i;
+	}
+	
+	FILE *fp=fopen(fileName.toLocal8Bit().constData(),"wb");
+	
+	if(!fp)
+		return;
+	
+	float stepX=(float)(field.xSize-1)/(float)(targetX-1);
+	float stepY=(float)(field.ySize-1)/(float)(targetY-1);
+	float stepZ=(float)(field.zSize-1)/(float)(targetZ-1);
+	
+	std::vector<float> row(targetX*3);
+	
+	for(int z=0;z<targetZ;++z)
+		for(int y=0;y<targetY;++y)
+		{
+			for(int x=0;x<targetX;++x)
+			{
+				//the last sample is pinned to the far face so rounding never steps outside the field
+				GGL::Point3f v=field.getVector(x==targetX-1?field.xSize-1:x*stepX,
+				                               y==targetY-1?field.ySize-1:y*stepY,
+				                               z==targetZ-1?field.zSize-1:z*stepZ,level);
+				row[x*3]=v.X();
+				row[x*3+1]=v.Y();
+				row[x*3+2]=v.Z();
+			}
+			
+			fwrite(&row[0],sizeof(float),row.size(),fp);
+		}
+	
+	fclose(fp);
 }
 
 DownSampler::~DownSampler()
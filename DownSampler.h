@@ -46,6 +46,10 @@ private:
 public:
 	DownSampler(QString name,QWidget *parent);
 	~DownSampler();
+
+private slots:
+	void onDataUpdated();
+	void onSave();
 };
 
 #endif
\ No newline at end of file
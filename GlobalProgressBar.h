@@ -1,3 +1,4 @@
 #include <QtGui/QProgressBar>
 
-static QProgressBar *globalProgressBar=0;
\ No newline at end of file
+//created by MainWindow, shared by everything that reports progress in the status bar
+extern QProgressBar *globalProgressBar;
\ No newline at end of file
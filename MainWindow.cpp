@@ -14,6 +14,8 @@
 #include <QtCore/QTimer>
 #include "CustomCursorManager.h"
 
+QProgressBar *globalProgressBar=0;
+
 
 MainWindow::MainWindow(void):QMainWindow(0),activatedCanvas(0)
 {     
@@ -72,13 +72,9 @@ void Sample::generate(int i)
 
 void Sample::generateJacobian()
 {
-	const float epsilon=0.0001f;
-	
-        GGL::Point3f original=VectorField::getSingleton().getVector(pos.X(),pos.Y(),pos.Z());
-	
-        GGL::Point3f xx=VectorField::getSingleton().getVector(pos.X()+epsilon,pos.Y(),pos.Z());
-        GGL::Point3f yy=VectorField::getSingleton().getVector(pos.X(),pos.Y()+epsilon,pos.Z());
-        GGL::Point3f zz=VectorField::getSingleton().getVector(pos.X(),pos.Y(),pos.Z()+epsilon);
+        float derivatives[3][3];
+
+        GGL::Point3f original=VectorField::getSingleton().getVectorAndJacobian(pos.X(),pos.Y(),pos.Z(),derivatives);
 	
         alglib::real_2d_array a;
         a = "[[5,2,4],[-3,6,2],[3,-3,1]]";
@@ -97,18 +93,10 @@ void Sample::generateJacobian()
         jacobian[2][2]=(zz.Z()-original.Z())/epsilon;
 */
 
-        a[0][0]=(xx.X()-original.X())/epsilon;
-            a[1][0]=(yy.X()-original.X())/epsilon;
-            a[2][0]=(zz.X()-original.X())/epsilon;
-
-
-            a[0][1]=(xx.Y()-original.Y())/epsilon;
-            a[1][1]=(yy.Y()-original.Y())/epsilon;
-            a[2][1]=(zz.Y()-original.Y())/epsilon;
-
-            a[0][2]=(xx.Z()-original.Z())/epsilon;
-            a[1][2]=(yy.Z()-original.Z())/epsilon;
-            a[2][2]=(zz.Z()-original.Z())/epsilon;
+        //row j holds the derivative along axis j
+        for(int j=0;j<3;++j)
+            for(int i=0;i<3;++i)
+                a[j][i]=derivatives[i][j];
 
 qDebug("{{%f,%f,%f},{%f,%f,%f},{%f,%f,%f}}",a[0][0],a[0][1],a[0][2],a[1][0],a[1][1],a[1][2],a[2][0],a[2][1],a[2][2]);
 
@@ -293,25 +281,16 @@ void Sample::operator=(const Sample & in)
 
 void Sample::computeSignature()
 {
-	const float epsilon=0.0001f;
-	
-        GGL::Point3f original=VectorField::getSingleton().getVector(pos.X(),pos.Y(),pos.Z());
-	
-        GGL::Point3f xx=VectorField::getSingleton().getVector(pos.X()+epsilon*x.X(),pos.Y()+epsilon*x.Y(),pos.Z()+epsilon*x.Z());
-        GGL::Point3f yy=VectorField::getSingleton().getVector(pos.X()+epsilon*y.X(),pos.Y()+epsilon*y.Y(),pos.Z()+epsilon*y.Z());
-        GGL::Point3f zz=VectorField::getSingleton().getVector(pos.X()+epsilon*z.X(),pos.Y()+epsilon*z.Y(),pos.Z()+epsilon*z.Z());
-	
-        signature[0][0]=(xx.X()-original.X())/epsilon;
-        signature[0][1]=(yy.X()-original.X())/epsilon;
-        signature[0][2]=(zz.X()-original.X())/epsilon;
-	
-        signature[1][0]=(xx.Y()-original.Y())/epsilon;
-        signature[1][1]=(yy.Y()-original.Y())/epsilon;
-        signature[1][2]=(zz.Y()-original.Y())/epsilon;
-	
-        signature[2][0]=(xx.Z()-original.Z())/epsilon;
-        signature[2][1]=(yy.Z()-original.Z())/epsilon;
-        signature[2][2]=(zz.Z()-original.Z())/epsilon;
+        float derivatives[3][3];
+
+        GGL::Point3f original=VectorField::getSingleton().getVectorAndJacobian(pos.X(),pos.Y(),pos.Z(),derivatives);
+
+        //directional derivatives along the local frame, column j is the jacobian applied to axis j
+        const GGL::Point3f *axes[3]={&x,&y,&z};
+
+        for(int i=0;i<3;++i)
+            for(int j=0;j<3;++j)
+                signature[i][j]=derivatives[i][0]*axes[j]->X()+derivatives[i][1]*axes[j]->Y()+derivatives[i][2]*axes[j]->Z();
 	
         float length=original.length();
 	
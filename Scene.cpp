@@ -2,6 +2,7 @@
 #include <QtOpenGL/QGLWidget>
 #include "Scene.h"
 #include "VectorField.h"
+#include "integrator.h"
 #include "GLSLShader.h"
 #include "Camera.h"
 #include "model.h"
@@ -74,47 +75,8 @@ GGL::Point3f Scene::updateAPoint(float x,float y,float z)
 {
 	//2.5f for tornado
 	//0.05 for solar
-	/*const float deltaT=2.5f;
-	//const float deltaT=0.01f;
-	
-	GGL::Point3f pos(x,y,z);
-
-         dir=VectorField::getSingleton().getVector(x,y,z);
-
-	GGL::Point3f dd(dir.x,dir.y,dir.z);
-
-	GGL::Point3f k1(dd*deltaT);
-
-	GGL::Point3f tempP=pos+(k1*0.5f);
-
-	dir=VectorField::getSingleton().getVector(tempP.X(),tempP.Y(),tempP.Z());
-
-	dd.vec(dir.x,dir.y,dir.z);
-
-	GGL::Point3f k2=dd*deltaT;
-
-	tempP=pos+k2*0.5f;
-
-	dir=VectorField::getSingleton().getVector(tempP.X(),tempP.Y(),tempP.Z());
-
-
-	dd.vec(dir.x,dir.y,dir.z);
-
-	GGL::Point3f k3=dd*deltaT;
-
-	tempP=pos+(k3*0.5f);
-
-	dir=VectorField::getSingleton().getVector(tempP.X(),tempP.Y(),tempP.Z());
-
-	dd.vec(dir.x,dir.y,dir.z);
-
-	GGL::Point3f k4=dd*deltaT;
-
-	pos+=(k1+k2*2.0f+k3*3.0f+k4)*(1.0f/6.0f);
-
-	return pos;*/
-
-    return GGL::Point3f();
+	FieldSampler sampler;
+	return rk4Step<ForwardIntegration>(GGL::Point3f(x,y,z),FixedStep(2.5f),sampler);
 }
 
 
@@ -301,13 +263,7 @@ void Scene::testDrawForPillow(Camera *currentCamera)
 
         SeedingIdeaData::getSingleton().draw();
 
-        if(Streamline::streamlinePool.size())
-        {
-            for(std::vector<Streamline>::iterator iter=Streamline::streamlinePool.begin();iter!=Streamline::streamlinePool.end();++iter)
-            {
-                iter->draw();
-            }
-        }
+        Streamline::drawPool();
 
         DrawIllustrativeData::getSingleton().draw(currentCamera->from());
 
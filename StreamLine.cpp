@@ -7,14 +7,24 @@
  *
  */
 
+#include <GL/glew.h>
 #include "StreamLine.h"
 #include "VectorField.h"
+#include "integrator.h"
+#include "earlytermination.h"
 #include <QGLWidget>
 //#include <sys/time.h>
 
-std::vector<Streamline> Streamline::streamlinePool;
+StreamlineStore Streamline::streamlinePool;
+Streamline::Integrator Streamline::integrator=Streamline::ClassicRK4;
+float Streamline::tolerance=0.0001f;
+VertexBuffer Streamline::poolBuffer;
 
-Streamline::Streamline()
+//the fixed step integrator covers about this much arc length, the adaptive one stops there too
+static const float maxLineLength=750.0f;
+static const int maxAdaptiveSteps=5000;
+
+Streamline::Streamline():samples(0),cellFetches(0)
 {
 
 }
@@ -24,59 +34,43 @@ Streamline::~Streamline()
 
 }
 
+void Streamline::setIntegrator(Integrator _integrator,float _tolerance)
+{
+	integrator=_integrator;
+	tolerance=_tolerance;
+}
 
-GGL::Point3f Streamline::movePoint(float x,float y,float z)
+//stops where the field vanishes or the rest of the line would not be visible, and prefetches the
+//bricks ahead of every accepted step
+struct StreamlineEnd
 {
-	
-	
-	
-	//const float deltaT=0.025f;
-	
-	GGL::Point3f pos(x,y,z);
-	
-        GGL::Point3f dir=VectorField::getSingleton().getVector(x,y,z);
-	
-        float deltaT=1.5f/(dir.length());
-	
-	if (deltaT>2.0f) {
-		deltaT=1.5f;
+	VectorField &field;
+	EarlyTermination early;
+
+	StreamlineEnd(const std::vector<GGL::Point3f> &points,int maxSteps):field(VectorField::getSingleton()),early(points,1.0f,maxSteps)
+	{}
+
+	bool operator()(const GGL::Point3f &from,const GGL::Point3f &to)
+	{
+		if (early(from,to)) {
+			return true;
+		}
+
+		field.prefetch(to,to-from);
+		return false;
 	}
-	
-        GGL::Point3f dd(dir);
-	
-	GGL::Point3f k1(dd*deltaT);
-	
-	GGL::Point3f tempP=pos+(k1*0.5f);
-	
-	dir=VectorField::getSingleton().getVector(tempP.X(),tempP.Y(),tempP.Z());
-	
-        dd=(dir);
-	
-	GGL::Point3f  k2=dd*deltaT;
-	
-	tempP=pos+k2*0.5f;
-	
-	dir=VectorField::getSingleton().getVector(tempP.X(),tempP.Y(),tempP.Z());
-	
-	
-        dd=(dir);
-	
-	GGL::Point3f  k3=dd*deltaT;
-	
-	tempP=pos+(k3*0.5f);
-	
-	dir=VectorField::getSingleton().getVector(tempP.X(),tempP.Y(),tempP.Z());
-	
-        dd=(dir);
-	
-	GGL::Point3f  k4=dd*deltaT;
-	
-	pos+=(k1+k2*2.0f+k3*3.0f+k4)*(1.0f/6.0f);
-	
-	return pos;
-}
+};
+
+float Streamline::getLength() const
+{
+	float length=0.0f;
 
+	for (size_t i=1; i<pointlist.size(); ++i) {
+		length+=(pointlist[i]-pointlist[i-1]).length();
+	}
 
+	return length;
+}
 
 void Streamline::draw()
 {
@@ -88,44 +82,64 @@ void Streamline::draw()
 	glEnd();
 }
 
-Streamline::Streamline(const Streamline & in)
+void Streamline::drawPool()
+{
+	streamlinePool.draw(poolBuffer);
+}
+
+Streamline::Streamline(const Streamline & in):pointlist(in.pointlist),samples(in.samples),cellFetches(in.cellFetches)
 {
-	pointlist.clear();
-	pointlist.resize(in.pointlist.size());
-	std::copy(in.pointlist.begin(),in.pointlist.end(),pointlist.begin());
 }
 
 void Streamline::operator=(const Streamline & in)
 {
-	pointlist.clear();
-	pointlist.resize(in.pointlist.size());
-	std::copy(in.pointlist.begin(),in.pointlist.end(),pointlist.begin());
+	samples=in.samples;
+	cellFetches=in.cellFetches;
+	pointlist=in.pointlist;
 }
 
-void Streamline::generate(GGL::Point3f &start)
+//appends the line from start to points with the selected integrator
+static void traceLine(const GGL::Point3f &start,int level,Streamline::Integrator integrator,float tolerance,std::vector<GGL::Point3f> &points,int &samples,int &cellFetches)
 {
-	GGL::Point3f current(start.X(),start.Y(),start.Z());
-	
-	pointlist.push_back(current);
-	
-	for (int i=0; i<500; ++i) 
-	{
-		GGL::Point3f newpos=movePoint(current.X(),current.Y(),current.Z());
-		float length=(newpos-current).length();
-		
-		if (length<0.00001f) {
-			break;
-		}
-		
-		current=newpos;
-		pointlist.push_back(current);
+	CellSampler sampler(level);
+
+	if (integrator==Streamline::DormandPrince54) {
+		StreamlineEnd end(points,maxAdaptiveSteps);
+		dormandPrinceTrace<ForwardIntegration>(start,maxLineLength,maxAdaptiveSteps,AdaptiveStep(tolerance),sampler,end,points);
+	}
+	else {
+		StreamlineEnd end(points,500);
+		rk4Trace<ForwardIntegration>(start,500,SpeedScaledStep(),sampler,end,points);
 	}
+
+	samples+=sampler.getSamples();
+	cellFetches+=sampler.getFetches();
+}
+
+void Streamline::generate(GGL::Point3f &start,int level)
+{
+	traceLine(start,level,integrator,tolerance,pointlist,samples,cellFetches);
+}
+
+void Streamline::trace(const GGL::Point3f &start,int level,StreamlineStore &store)
+{
+	int lineSamples=0;
+	int lineFetches=0;
+
+	traceLine(start,level,integrator,tolerance,store.beginLine(),lineSamples,lineFetches);
+
+	store.endLine(lineSamples,lineFetches);
+}
+
+GGL::Point3f Streamline::randomSeed()
+{
+	return GGL::Point3f( (float)(rand()%6400)/6400.0f*(VectorField::getSingleton().xSize-1) , 
+	                     (float)(rand()%6400)/6400.0f*(VectorField::getSingleton().ySize-1) ,
+	                     (float)(rand()%6400)/6400.0f*(VectorField::getSingleton().zSize-1) );
 }
 
-void Streamline::generateRandomly()
+void Streamline::generateRandomly(int level)
 {
-	GGL::Point3f start( (float)(rand()%6400)/6400.0f*(VectorField::getSingleton().xSize-1) , 
-	                    (float)(rand()%6400)/6400.0f*(VectorField::getSingleton().ySize-1) ,
-	                    (float)(rand()%6400)/6400.0f*(VectorField::getSingleton().zSize-1) );
-	generate(start);
+	GGL::Point3f start=randomSeed();
+	generate(start,level);
 }
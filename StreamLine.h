@@ -12,22 +12,68 @@
 
 #include <vector>
 #include "Point3.h"
+#include "streamlinestore.h"
+#include "vertexbuffer.h"
 
 class Streamline
 {
 public:
-    static std::vector<Streamline> streamlinePool;
+    static StreamlineStore streamlinePool;
+
+    //ClassicRK4 takes 500 steps of about 1.5 voxels, DormandPrince54 follows the normalized field
+    //with an error controlled step and stops at the same nominal length
+    enum Integrator {ClassicRK4, DormandPrince54};
 
 private:
 	std::vector<GGL::Point3f> pointlist;
-	GGL::Point3f movePoint(float x,float y,float z);
+	int samples;
+	int cellFetches;
+
+	static Integrator integrator;
+	static float tolerance;
+
+	static VertexBuffer poolBuffer;
 	
 public:
+	//tolerance is the largest position error accepted per step, in voxels
+	static void setIntegrator(Integrator _integrator,float _tolerance=0.0001f);
+
+	static Integrator getIntegrator()
+	{
+		return integrator;
+	};
+
+	//field samples spent tracing this line
+	int getSampleCount() const
+	{
+		return samples;
+	};
+
+	//cell corner loads behind those samples, a sample inside the previous cell reuses its corners
+	int getCellFetchCount() const
+	{
+		return cellFetches;
+	};
+
+	int getPointCount() const
+	{
+		return (int)pointlist.size();
+	};
+
+	float getLength() const;
+
 	Streamline();
 	~Streamline();
 	void draw();
-	void generate(GGL::Point3f &start);
-	void generateRandomly();
+	//every line in streamlinePool, from a vertex buffer refilled only after the pool changed
+	static void drawPool();
+	//level picks a coarser level of the field pyramid, cheap previews trace on level 1 or 2
+	void generate(GGL::Point3f &start,int level=0);
+	void generateRandomly(int level=0);
+	//traces the same line as generate straight into a store, no per line allocation
+	static void trace(const GGL::Point3f &start,int level,StreamlineStore &store);
+	//a uniformly distributed start point inside the loaded field
+	static GGL::Point3f randomSeed();
 	
 	Streamline(const Streamline& in);
 	void operator=(const Streamline& in);
@@ -1,13 +1,165 @@
+#include <GL/glew.h>
 #include "VectorField.h"
 #include <fstream>
 #include <math.h>
 #include <vector>
+#include <algorithm>
+#include <string.h>
 #include <QGLWidget>
+#include <QtCore/QVector>
+#include <QtCore/QtConcurrentMap>
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
 #include "Point3.h"
+#include "brickcache.h"
+#include "framering.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+#define VECTORFIELD_SSE
+#include <emmintrin.h>
+#endif
 
 
 
+
+struct MagnitudeSlab
+{
+    const void *field;
+    int count;
+    //a cancelled load skips the slabs not yet started
+    const volatile bool *cancelled;
+};
+
+struct MagnitudeRange
+{
+    float minMag;
+    float maxMag;
+
+    MagnitudeRange():minMag(10000000000.0f),maxMag(-1.0f)
+    {}
+};
+
+static MagnitudeRange slabMagnitudeRange(const MagnitudeSlab &slab)
+{
+    MagnitudeRange result;
+
+    if(*slab.cancelled)
+        return result;
+
+    const float *v=(const float *)slab.field;
+
+    for(int i=0;i<slab.count;++i,v+=3)
+    {
+        float mag=sqrt(v[0]*v[0]+v[1]*v[1]+v[2]*v[2]);
+
+        if(mag>result.maxMag)
+            result.maxMag=mag;
+
+        if(mag<result.minMag)
+            result.minMag=mag;
+    }
+
+    return result;
+}
+
+static void mergeMagnitudeRange(MagnitudeRange &result,const MagnitudeRange &slab)
+{
+    if(slab.maxMag>result.maxMag)
+        result.maxMag=slab.maxMag;
+
+    if(slab.minMag<result.minMag)
+        result.minMag=slab.minMag;
+}
+
+VectorField::~VectorField(void)
+{
+    release();
+    delete brickCache;
+    delete frameRing;
+}
+
+void VectorField::releaseMapping()
+{
+    if(mappedFile)
+    {
+        mappedFile->unmap(mappedData);
+        mappedFile->close();
+        delete mappedFile;
+        mappedFile=NULL;
+        mappedData=NULL;
+    }
+}
+
+void VectorField::releaseSource()
+{
+    //a container mapping also backs the brick ranges, the pyramid and the bricks, release() unmaps it
+    if(mappedFile)
+    {
+        if(mappedData==(uchar *)vectorField)
+            releaseMapping();
+    }
+    else if(ownsField && vectorField)
+    {
+        delete [] vectorField;
+    }
+
+    vectorField=NULL;
+    ownsField=false;
+}
+
+void VectorField::release()
+{
+    if(!mappedBricks)
+    {
+        delete [] brickedField;
+        delete [] brickOffsets;
+    }
+
+    delete [] packedField;
+    delete [] brickScale;
+    delete [] brickBias;
+
+    brickedField=NULL;
+    packedField=NULL;
+    brickScale=NULL;
+    brickBias=NULL;
+    brickOffsets=NULL;
+
+    mappedBricks=false;
+    brickMagnitudes=NULL;
+
+    releasePyramid();
+    releaseSource();
+    releaseMapping();
+
+    if(brickCache)
+        brickCache->close();
+
+    if(frameRing)
+        frameRing->close();
+
+    activeLayout=LinearLayout;
+    storageError=0.0f;
+}
+
+void VectorField::computeMagnitudeRange()
+{
+    //one z slice per task, the pages of a mapped file are faulted in by the worker threads
+    QVector<MagnitudeSlab> slabs(zSize);
+
+    for(int z=0;z<zSize;++z)
+    {
+        slabs[z].field=vectorField+z*xSize*ySize;
+        slabs[z].count=xSize*ySize;
+        slabs[z].cancelled=&loadCancelled;
+    }
+
+    MagnitudeRange range=QtConcurrent::blockingMappedReduced<MagnitudeRange>(slabs,slabMagnitudeRange,mergeMagnitudeRange);
+
+    minMag=range.minMag;
+    maxMag=range.maxMag;
+}
+
 void VectorField::init(const char *filename,int _sizex,int _sizey,int _sizez,const QString & _dataName)
 {
     dataName=_dataName;
@@ -16,107 +168,1317 @@ void VectorField::init(const char *filename,int _sizex,int _sizey,int _sizez,con
 	ySize=_sizey;
 	zSize=_sizez;
 	
-	
-	if (vectorField) {
-		delete [] vectorField;
-	}
-	
-	vectorField=new FVector[xSize*ySize*zSize];
-	
-	FILE *fp=fopen(filename,"rb");
-	fread(vectorField ,sizeof(struct FVector),xSize*ySize*zSize,fp);
-	fclose(fp);
+	release();
+
+        //a container knows its own size and is always stored as native floats
+        FieldContainerHeader container;
+        bool isContainer=readFieldContainerHeader(filename,container);
+        FieldFormat format=sourceFormat;
+        qint64 firstVector=0;
+
+        if(isContainer)
+        {
+            xSize=container.xSize;
+            ySize=container.ySize;
+            zSize=container.zSize;
+            format=FieldFormat();
+            firstVector=container.payloadOffset/sizeof(struct FVector);
+        }
+
+        if(storageLayout==OutOfCoreLayout)
+        {
+            if(openBrickCache(filename,format,firstVector))
+            {
+                emit loadProgress(50);
+
+                if(loadAborted())
+                    return;
+
+                emit loadProgress(100);
+                emit dataUpdated();
+                return;
+            }
 
-	for(int x=0;x<xSize;++x)
-		for(int y=0;y<ySize;++y)
-			for(int z=0;z<zSize;++z)
-			{
-				FVector v=vectorField[(int)x + (int)y*xSize + (int)z*xSize*ySize];
+            //a brick file build stopped by a cancel, not one that failed
+            if(loadAborted())
+                return;
+        }
 
-				float mag=sqrt(v.x*v.x+v.y*v.y+v.z*v.z);
+        qint64 fieldBytes=(qint64)xSize*ySize*zSize*sizeof(struct FVector);
 
-				if(mag>maxMag)
-					maxMag=mag;
-				
-				if(mag<minMag)
-					minMag=mag;
-			}
+        if(isContainer)
+        {
+            //the header was checked against the file, so a container the platform refused to map
+            //is read into a private copy below like any native source
+            if(!mapContainer(filename,container))
+                qDebug("Could not map %s, reading it instead",filename);
+        }
+        else if(format.isNative())
+        {
+            QFile *file=new QFile(filename);
 
+            if(file->open(QIODevice::ReadOnly) && file->size()>=fieldBytes)
+            {
+                uchar *mapped=file->map(0,fieldBytes);
+
+                if(mapped)
+                {
+                    vectorField=(struct FVector *)mapped;
+                    mappedData=mapped;
+                    mappedFile=file;
+                }
+            }
+
+            if(!mappedFile)
+                delete file;
+        }
+
+        if(!mappedFile)
+        {
+            //a converted source, or the platform refused to map the file, is read into a private copy
+            vectorField=new FVector[xSize*ySize*zSize];
+            ownsField=true;
+
+            FieldReader reader(format);
+
+            if(reader.open(filename,firstVector))
+            {
+                for(int z=0;z<zSize && !loadCancelled;++z)
+                {
+                    reader.read(&vectorField[z*xSize*ySize].x,xSize*ySize);
+                    emit loadProgress(25*(z+1)/zSize);
+                }
+            }
+        }
+
+        if(loadAborted())
+            return;
+
+        if(isContainer)
+        {
+            minMag=container.minMag;
+            maxMag=container.maxMag;
+        }
+        else
+            computeMagnitudeRange();
+
+        emit loadProgress(40);
+
+        if(loadAborted())
+            return;
+
+        buildLayout();
+
+        emit loadProgress(70);
+
+        if(loadAborted())
+            return;
+
+        buildPyramid();
+
+        if(loadAborted())
+            return;
+
+        emit loadProgress(100);
         emit dataUpdated();
 }
 
+bool VectorField::loadAborted()
+{
+    if(!loadCancelled)
+        return false;
+
+    release();
+    xSize=ySize=zSize=0;
+
+    return true;
+}
+
+VectorField *VectorField::createStaging()
+{
+    VectorField &current=getSingleton();
+    VectorField *staging=new VectorField();
+
+    staging->storageLayout=current.storageLayout;
+    staging->cacheBudget=current.cacheBudget;
+    staging->pyramidLevels=current.pyramidLevels;
+    staging->frameRingSize=current.frameRingSize;
+    staging->sourceFormat=current.sourceFormat;
+    staging->deltaT=current.deltaT;
+    staging->colorSize=current.colorSize;
+
+    return staging;
+}
+
+void VectorField::beginBackgroundRead()
+{
+    backgroundReads.ref();
+}
+
+void VectorField::endBackgroundRead()
+{
+    //emitted from the worker, the connection to FieldLoader queues it to the GUI thread
+    if(!backgroundReads.deref())
+        emit backgroundReadsEnded();
+}
+
+void VectorField::publish(VectorField *staging)
+{
+    //settings stay with this field, everything describing the loaded data changes hands
+    std::swap(dataName,staging->dataName);
+    std::swap(mappedFile,staging->mappedFile);
+    std::swap(mappedData,staging->mappedData);
+    std::swap(ownsField,staging->ownsField);
+    std::swap(storageError,staging->storageError);
+    std::swap(activeLayout,staging->activeLayout);
+    std::swap(brickedField,staging->brickedField);
+    std::swap(packedField,staging->packedField);
+    std::swap(brickScale,staging->brickScale);
+    std::swap(brickBias,staging->brickBias);
+    std::swap(brickOffsets,staging->brickOffsets);
+    std::swap(mappedBricks,staging->mappedBricks);
+    std::swap(mappedLevels,staging->mappedLevels);
+    std::swap(brickMagnitudes,staging->brickMagnitudes);
+    std::swap(xBricks,staging->xBricks);
+    std::swap(yBricks,staging->yBricks);
+    std::swap(zBricks,staging->zBricks);
+    std::swap(brickCache,staging->brickCache);
+    std::swap(frameRing,staging->frameRing);
+    pyramid.swap(staging->pyramid);
+    std::swap(maxMag,staging->maxMag);
+    std::swap(minMag,staging->minMag);
+    std::swap(vectorField,staging->vectorField);
+    std::swap(xSize,staging->xSize);
+    std::swap(ySize,staging->ySize);
+    std::swap(zSize,staging->zSize);
+
+    ++generation;
+
+    delete staging;
+
+    emit dataUpdated();
+}
+
+
+
+void VectorField::initSeries(const QString &pattern,int firstStep,int stepCount,int _sizex,int _sizey,int _sizez,const QString & _dataName)
+{
+    QString first=pattern;
+
+    if(pattern.contains('%'))
+        first.sprintf(pattern.toLocal8Bit().constData(),firstStep);
+
+    //a single file with every step back to back starts with the first frame, so init reads just that
+    init(first.toLocal8Bit().constData(),_sizex,_sizey,_sizez,_dataName);
+
+    if(stepCount>1 && !loadCancelled)
+    {
+        if(!frameRing)
+            frameRing=new FrameRing();
+
+        frameRing->open(pattern,sourceFormat,firstStep,stepCount,_sizex,_sizey,_sizez,frameRingSize);
+    }
+}
+
+int VectorField::getStepCount()
+{
+    if(frameRing && frameRing->getStepCount()>1)
+        return frameRing->getStepCount();
+
+    return 1;
+}
+
+const float *VectorField::acquireFrame(int frame)
+{
+    if(getStepCount()<2)
+        return NULL;
+
+    return frameRing->acquire(frame);
+}
+
+void VectorField::releaseFrame(int frame)
+{
+    if(getStepCount()>1)
+        frameRing->release(frame);
+}
+
+bool VectorField::openBrickCache(const char *filename,const FieldFormat &format,qint64 firstVector)
+{
+    if(!brickCache)
+        brickCache=new BrickCache();
+
+    //the brick file is built once next to the dataset, or in the temp directory when that is read only
+    QString bricked=QString(filename)+".bricks";
+    QString temporary=QDir::temp().filePath(QFileInfo(bricked).fileName());
+
+    int tag=format.tag();
+
+    if(!brickCache->open(bricked,filename,tag,xSize,ySize,zSize,cacheBudget) && !brickCache->open(temporary,filename,tag,xSize,ySize,zSize,cacheBudget))
+    {
+        bool opened=(BrickCache::buildBrickFile(filename,format,bricked,xSize,ySize,zSize,firstVector,&loadCancelled)
+                     && brickCache->open(bricked,filename,tag,xSize,ySize,zSize,cacheBudget))
+                || (!loadCancelled && BrickCache::buildBrickFile(filename,format,temporary,xSize,ySize,zSize,firstVector,&loadCancelled)
+                     && brickCache->open(temporary,filename,tag,xSize,ySize,zSize,cacheBudget));
+
+        if(!opened)
+            return false;
+    }
+
+    minMag=brickCache->minMag;
+    maxMag=brickCache->maxMag;
+    activeLayout=OutOfCoreLayout;
+
+    return true;
+}
+
+void VectorField::prefetch(const GGL::Point3f &pos,const GGL::Point3f &dir)
+{
+    if(activeLayout==OutOfCoreLayout)
+        brickCache->prefetch(pos.X(),pos.Y(),pos.Z(),dir.X(),dir.Y(),dir.Z());
+}
+
+static inline unsigned int spreadBits(unsigned int v)
+{
+    v&=0x3ff;
+    v=(v|(v<<16))&0x030000ff;
+    v=(v|(v<<8))&0x0300f00f;
+    v=(v|(v<<4))&0x030c30c3;
+    v=(v|(v<<2))&0x09249249;
+    return v;
+}
+
+static inline unsigned int mortonCode(unsigned int x,unsigned int y,unsigned int z)
+{
+    return spreadBits(x)|(spreadBits(y)<<1)|(spreadBits(z)<<2);
+}
+
+struct BrickOrder
+{
+    unsigned int code;
+    int brick;
+
+    bool operator<(const BrickOrder &in) const
+    {
+        return code<in.code;
+    }
+};
+
+static inline unsigned short floatToHalf(float value)
+{
+    unsigned int f;
+    memcpy(&f,&value,sizeof(f));
+
+    unsigned int sign=(f>>16)&0x8000;
+    int exponent=(int)((f>>23)&0xff)-127+15;
+    unsigned int mantissa=f&0x7fffff;
+
+    if(((f>>23)&0xff)==0xff)
+        return sign|0x7c00|(mantissa?0x200:0);
+
+    if(exponent>=31)
+        return sign|0x7c00;
+
+    if(exponent<=0)
+    {
+        if(exponent<-10)
+            return sign;
+
+        mantissa|=0x800000;
+
+        int shift=14-exponent;
+        unsigned int half=mantissa>>shift;
+
+        if((mantissa>>(shift-1))&1)
+            ++half;
+
+        return sign|half;
+    }
+
+    unsigned int half=sign|(exponent<<10)|(mantissa>>13);
+
+    //a carry out of the mantissa correctly bumps the exponent
+    if(mantissa&0x1000)
+        ++half;
+
+    return half;
+}
+
+static inline float halfToFloat(unsigned short half)
+{
+    unsigned int sign=(half&0x8000)<<16;
+    unsigned int exponent=(half>>10)&0x1f;
+    unsigned int mantissa=half&0x3ff;
+
+    unsigned int f;
+
+    if(exponent==0)
+    {
+        float denormal=mantissa*(1.0f/16777216.0f);
+        return sign?-denormal:denormal;
+    }
+    else if(exponent==31)
+        f=sign|0x7f800000|(mantissa<<13);
+    else
+        f=sign|((exponent+112)<<23)|(mantissa<<13);
+
+    float value;
+    memcpy(&value,&f,sizeof(value));
+    return value;
+}
+
+void VectorField::mortonBrickOffsets(int _xBricks,int _yBricks,int _zBricks,int *offsets)
+{
+    int brickCount=_xBricks*_yBricks*_zBricks;
+
+    //bricks are placed along the Z-order curve, the offset table maps a brick coordinate to its slot
+    std::vector<BrickOrder> order(brickCount);
+
+    for(int bz=0;bz<_zBricks;++bz)
+        for(int by=0;by<_yBricks;++by)
+            for(int bx=0;bx<_xBricks;++bx)
+            {
+                int brick=bx+by*_xBricks+bz*_xBricks*_yBricks;
+                order[brick].code=mortonCode(bx,by,bz);
+                order[brick].brick=brick;
+            }
+
+    std::sort(order.begin(),order.end());
+
+    for(int slot=0;slot<brickCount;++slot)
+        offsets[order[slot].brick]=slot*brickVoxels;
+}
+
+void VectorField::buildBrickOrder()
+{
+    xBricks=(xSize+brickSize-1)>>brickBits;
+    yBricks=(ySize+brickSize-1)>>brickBits;
+    zBricks=(zSize+brickSize-1)>>brickBits;
+
+    brickOffsets=new int[xBricks*yBricks*zBricks];
+
+    mortonBrickOffsets(xBricks,yBricks,zBricks,brickOffsets);
+}
+
+VectorField::FVector VectorField::fetchVoxel(int x,int y,int z) const
+{
+    if(vectorField)
+        return vectorField[x+y*xSize+z*xSize*ySize];
+
+    //the last voxel along an axis is the far corner of the last cell
+    int cx=qMin(x,xSize-2);
+    int cy=qMin(y,ySize-2);
+    int cz=qMin(z,zSize-2);
+
+    FVector corners[8];
+    fetchCell(cx,cy,cz,corners);
+
+    return corners[((x-cx)<<2)|((y-cy)<<1)|(z-cz)];
+}
+
+void VectorField::gatherBrick(int bx,int by,int bz,FVector *target) const
+{
+    //voxels hanging over the border replicate the last sample so a brick is always complete
+    for(int lz=0;lz<brickSize;++lz)
+        for(int ly=0;ly<brickSize;++ly)
+            for(int lx=0;lx<brickSize;++lx)
+            {
+                int x=qMin((bx<<brickBits)+lx,xSize-1);
+                int y=qMin((by<<brickBits)+ly,ySize-1);
+                int z=qMin((bz<<brickBits)+lz,zSize-1);
+
+                target[lx+(ly<<brickBits)+(lz<<(2*brickBits))]=fetchVoxel(x,y,z);
+            }
+}
+
+void VectorField::buildLayout()
+{
+    //OutOfCoreLayout only gets here when no brick cache could be opened, the field is then in memory
+    activeLayout=storageLayout==OutOfCoreLayout?LinearLayout:storageLayout;
+    storageError=0.0f;
+
+    if(activeLayout==LinearLayout)
+        return;
+
+    //the bricked copy of a container is used as mapped
+    if(mappedBricks)
+    {
+        releaseSource();
+        return;
+    }
+
+    buildBrickOrder();
+
+    int brickCount=xBricks*yBricks*zBricks;
+
+    if(activeLayout==BrickedLayout)
+        brickedField=new FVector[brickCount*brickVoxels];
+    else
+        packedField=new unsigned short[brickCount*brickVoxels*3];
+
+    if(activeLayout==QuantizedLayout)
+    {
+        brickScale=new float[brickCount*3];
+        brickBias=new float[brickCount*3];
+    }
+
+    FVector brickData[brickVoxels];
+
+    //a cancelled load stops here, init then releases the half built layout
+    for(int brick=0;brick<brickCount && !loadCancelled;++brick)
+    {
+        int offset=brickOffsets[brick];
+        int slot=offset/brickVoxels;
+        int bx=brick%xBricks;
+        int by=(brick/xBricks)%yBricks;
+        int bz=brick/(xBricks*yBricks);
+
+        if(activeLayout==BrickedLayout)
+        {
+            gatherBrick(bx,by,bz,brickedField+offset);
+            continue;
+        }
+
+        gatherBrick(bx,by,bz,brickData);
+
+        const float *source=&brickData[0].x;
+        unsigned short *target=packedField+offset*3;
+
+        if(activeLayout==HalfLayout)
+        {
+            for(int i=0;i<brickVoxels*3;++i)
+            {
+                target[i]=floatToHalf(source[i]);
+                storageError=qMax(storageError,(float)fabs(halfToFloat(target[i])-source[i]));
+            }
+        }
+        else
+        {
+            //each component gets its own 16 bit range per brick
+            for(int c=0;c<3;++c)
+            {
+                float low=source[c];
+                float high=source[c];
+
+                for(int i=1;i<brickVoxels;++i)
+                {
+                    low=qMin(low,source[i*3+c]);
+                    high=qMax(high,source[i*3+c]);
+                }
+
+                float scale=(high-low)/65535.0f;
+
+                brickScale[slot*3+c]=scale;
+                brickBias[slot*3+c]=low;
+
+                for(int i=0;i<brickVoxels;++i)
+                {
+                    float q=scale>0.0f?(source[i*3+c]-low)/scale+0.5f:0.0f;
+                    target[i*3+c]=(unsigned short)qMin(q,65535.0f);
+                    storageError=qMax(storageError,(float)fabs(low+target[i*3+c]*scale-source[i*3+c]));
+                }
+            }
+        }
+    }
+
+    //every sample is now served from the re-laid copy
+    releaseSource();
+}
+
+bool VectorField::mapContainer(const char *filename,const FieldContainerHeader &header)
+{
+    //the grid of this field, the header's own counts are only compared against it
+    int brickCount=((xSize+brickSize-1)>>brickBits)*((ySize+brickSize-1)>>brickBits)*((zSize+brickSize-1)>>brickBits);
+    qint64 fieldBytes=(qint64)xSize*ySize*zSize*sizeof(struct FVector);
+
+    QFile *file=new QFile(filename);
+
+    if(!file->open(QIODevice::ReadOnly) || file->size()<header.payloadOffset+fieldBytes)
+    {
+        delete file;
+        return false;
+    }
+
+    qint64 fileBytes=file->size();
+    uchar *mapped=file->map(0,fileBytes);
+
+    if(!mapped)
+    {
+        delete file;
+        return false;
+    }
+
+    mappedFile=file;
+    mappedData=mapped;
+    vectorField=(struct FVector *)(mapped+header.payloadOffset);
+
+    //optional sections are only used when they fit the file and this build's brick size
+    bool sameBricks=header.brickBits==brickBits;
+
+    if(sameBricks && header.brickRangeOffset>0 && header.brickRangeOffset%sizeof(float)==0
+            && header.brickRangeOffset+brickCount*2*(qint64)sizeof(float)<=fileBytes)
+        brickMagnitudes=(const float *)(mapped+header.brickRangeOffset);
+
+    if(header.pyramidOffset>0 && header.pyramidOffset%sizeof(float)==0)
+    {
+        qint64 offset=header.pyramidOffset;
+        int x=xSize;
+        int y=ySize;
+        int z=zSize;
+
+        for(int level=1;level<=qMin(header.pyramidLevels,pyramidLevels);++level)
+        {
+            PyramidLevel l;
+            l.xSize=x=(x+1)/2;
+            l.ySize=y=(y+1)/2;
+            l.zSize=z=(z+1)/2;
+            l.field=(struct FVector *)(mapped+offset);
+
+            offset+=(qint64)x*y*z*sizeof(struct FVector);
+
+            if(offset>fileBytes)
+                break;
+
+            pyramid.push_back(l);
+        }
+
+        mappedLevels=(int)pyramid.size();
+    }
+
+    //the brick grid must cover the field, the offset table and the bricks must lie inside the file
+    //at aligned addresses and every table entry must start a brick, a corrupt container falls back
+    //to building the layout
+    bool bricksFit=storageLayout==BrickedLayout && sameBricks && brickCount>0 && header.brickIndexOffset>0 && header.brickedOffset>0
+        && header.xBricks==(xSize+brickSize-1)>>brickBits && header.yBricks==(ySize+brickSize-1)>>brickBits
+        && header.zBricks==(zSize+brickSize-1)>>brickBits
+        && header.brickIndexOffset%sizeof(int)==0 && header.brickedOffset%sizeof(float)==0
+        && header.brickIndexOffset+brickCount*(qint64)sizeof(int)<=fileBytes
+        && header.brickedOffset+brickCount*(qint64)brickVoxels*(qint64)sizeof(struct FVector)<=fileBytes;
+
+    if(bricksFit)
+    {
+        const int *offsets=(const int *)(mapped+header.brickIndexOffset);
+
+        for(int i=0;i<brickCount && bricksFit;++i)
+            bricksFit=offsets[i]>=0 && offsets[i]%brickVoxels==0 && offsets[i]/brickVoxels<brickCount;
+    }
+
+    if(bricksFit)
+    {
+        xBricks=header.xBricks;
+        yBricks=header.yBricks;
+        zBricks=header.zBricks;
+        brickOffsets=(int *)(mapped+header.brickIndexOffset);
+        brickedField=(struct FVector *)(mapped+header.brickedOffset);
+        mappedBricks=true;
+    }
+
+    return true;
+}
+
+bool VectorField::saveContainer(const QString &filename,bool withBricks)
+{
+    if(xSize<2 || ySize<2 || zSize<2)
+        return false;
 
+    QFile out(filename);
+
+    if(!out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    int _xBricks=(xSize+brickSize-1)>>brickBits;
+    int _yBricks=(ySize+brickSize-1)>>brickBits;
+    int _zBricks=(zSize+brickSize-1)>>brickBits;
+    int brickCount=_xBricks*_yBricks*_zBricks;
+
+    FieldContainerHeader header;
+    memset(&header,0,sizeof(header));
+    memcpy(header.magic,"VFC1",4);
+    header.version=fieldContainerVersion;
+    header.byteOrder=fieldContainerByteOrder;
+    header.xSize=xSize;
+    header.ySize=ySize;
+    header.zSize=zSize;
+    header.elementType=FieldFormat::Float32;
+    header.minMag=minMag;
+    header.maxMag=maxMag;
+    header.brickBits=brickBits;
+    header.xBricks=_xBricks;
+    header.yBricks=_yBricks;
+    header.zBricks=_zBricks;
+    header.pyramidLevels=(int)pyramid.size();
+
+    //the sections follow each other in the order they are written below
+    qint64 offset=header.payloadOffset=fieldContainerPayloadOffset;
+    offset+=(qint64)xSize*ySize*zSize*sizeof(struct FVector);
+    header.brickRangeOffset=offset;
+    offset+=(qint64)brickCount*2*sizeof(float);
+
+    if(!pyramid.empty())
+    {
+        header.pyramidOffset=offset;
+
+        for(size_t i=0;i<pyramid.size();++i)
+            offset+=(qint64)pyramid[i].xSize*pyramid[i].ySize*pyramid[i].zSize*sizeof(struct FVector);
+    }
+
+    if(withBricks)
+    {
+        header.brickIndexOffset=offset;
+        header.brickedOffset=offset+brickCount*sizeof(int);
+    }
+
+    std::vector<char> front(fieldContainerPayloadOffset,0);
+    memcpy(&front[0],&header,sizeof(header));
+
+    bool result=out.write(&front[0],front.size())==(qint64)front.size();
+
+    //the payload is written a z slice at a time in whatever layout is active, the magnitude range
+    //of every brick is collected on the way
+    std::vector<float> ranges(brickCount*2);
+
+    for(int i=0;i<brickCount;++i)
+    {
+        ranges[i*2]=10000000000.0f;
+        ranges[i*2+1]=-1.0f;
+    }
+
+    std::vector<struct FVector> slice(xSize*ySize);
+
+    for(int z=0;z<zSize && result;++z)
+    {
+        for(int y=0;y<ySize;++y)
+            for(int x=0;x<xSize;++x)
+            {
+                struct FVector v=fetchVoxel(x,y,z);
+                slice[x+y*xSize]=v;
+
+                float mag=sqrt(v.x*v.x+v.y*v.y+v.z*v.z);
+                float *range=&ranges[((x>>brickBits)+(y>>brickBits)*_xBricks+(z>>brickBits)*_xBricks*_yBricks)*2];
+
+                range[0]=qMin(range[0],mag);
+                range[1]=qMax(range[1],mag);
+            }
+
+        qint64 bytes=(qint64)slice.size()*sizeof(struct FVector);
+        result=out.write((const char *)&slice[0],bytes)==bytes;
+    }
+
+    if(result)
+        result=out.write((const char *)&ranges[0],ranges.size()*sizeof(float))==(qint64)(ranges.size()*sizeof(float));
+
+    for(size_t i=0;i<pyramid.size() && result;++i)
+    {
+        qint64 bytes=(qint64)pyramid[i].xSize*pyramid[i].ySize*pyramid[i].zSize*sizeof(struct FVector);
+        result=out.write((const char *)pyramid[i].field,bytes)==bytes;
+    }
+
+    if(withBricks && result)
+    {
+        std::vector<int> offsets(brickCount);
+
+        if(brickedField)
+            memcpy(&offsets[0],brickOffsets,brickCount*sizeof(int));
+        else
+            mortonBrickOffsets(_xBricks,_yBricks,_zBricks,&offsets[0]);
+
+        result=out.write((const char *)&offsets[0],brickCount*sizeof(int))==(qint64)(brickCount*sizeof(int));
+
+        if(brickedField)
+        {
+            qint64 bytes=(qint64)brickCount*brickVoxels*sizeof(struct FVector);
+            result=result && out.write((const char *)brickedField,bytes)==bytes;
+        }
+        else
+        {
+            //bricks go out in slot order, so invert the offset table
+            std::vector<int> slotBrick(brickCount);
+
+            for(int brick=0;brick<brickCount;++brick)
+                slotBrick[offsets[brick]/brickVoxels]=brick;
+
+            struct FVector brickData[brickVoxels];
+
+            for(int slot=0;slot<brickCount && result;++slot)
+            {
+                int brick=slotBrick[slot];
+
+                gatherBrick(brick%_xBricks,(brick/_xBricks)%_yBricks,brick/(_xBricks*_yBricks),brickData);
+                result=out.write((const char *)brickData,sizeof(brickData))==(qint64)sizeof(brickData);
+            }
+        }
+    }
+
+    out.close();
+
+    if(!result)
+        QFile::remove(filename);
+
+    return result;
+}
+
+bool VectorField::convertToContainer(const char *source,const FieldFormat &format,int _sizex,int _sizey,int _sizez,const QString &target)
+{
+    //a private linear load keeps the current field untouched and the payload exact
+    VectorField *staging=createStaging();
+    staging->storageLayout=LinearLayout;
+    staging->sourceFormat=format;
+
+    staging->init(source,_sizex,_sizey,_sizez,QString());
+
+    bool result=staging->saveContainer(target);
+
+    delete staging;
+
+    return result;
+}
+
+bool VectorField::getContainerSize(const char *filename,int &x,int &y,int &z)
+{
+    FieldContainerHeader header;
+
+    if(!readFieldContainerHeader(filename,header))
+        return false;
+
+    x=header.xSize;
+    y=header.ySize;
+    z=header.zSize;
+
+    return true;
+}
+
+bool VectorField::getBrickMagnitudeRange(float x,float y,float z,float &low,float &high)
+{
+    if(!brickMagnitudes || x<0.0f || y<0.0f || z<0.0f || x>=xSize || y>=ySize || z>=zSize)
+        return false;
+
+    int _xBricks=(xSize+brickSize-1)>>brickBits;
+    int _yBricks=(ySize+brickSize-1)>>brickBits;
+
+    const float *range=brickMagnitudes+(((int)x>>brickBits)+((int)y>>brickBits)*_xBricks+((int)z>>brickBits)*_xBricks*_yBricks)*2;
+
+    low=range[0];
+    high=range[1];
+
+    return true;
+}
+
+QString VectorField::getStorageInfo()
+{
+    QString info;
+
+    switch(activeLayout)
+    {
+    case BrickedLayout:
+        info=QString("Bricked (Z-order), 12 bytes/voxel");
+        break;
+    case HalfLayout:
+        info=QString("Half float, 6 bytes/voxel, max error %1").arg(storageError);
+        break;
+    case QuantizedLayout:
+        info=QString("Quantized 16 bit, 6 bytes/voxel, max error %1").arg(storageError);
+        break;
+    case OutOfCoreLayout:
+        info=QString("Out-of-core, %1 of %2 bricks resident, %3 hits, %4 misses, %5 prefetched")
+                .arg(brickCache->getResidentBricks()).arg(brickCache->getBudgetBricks())
+                .arg(brickCache->getHits()).arg(brickCache->getMisses()).arg(brickCache->getPrefetched());
+        break;
+    default:
+        info=QString("Linear, 12 bytes/voxel");
+        break;
+    }
+
+    if(getStepCount()>1)
+        info+=QString("\nTime steps: %1, ring of %2 frames, %3 stalls, %4 prefetched")
+                .arg(getStepCount()).arg(frameRing->getRingSize()).arg(frameRing->getStalls()).arg(frameRing->getPrefetched());
+
+    return info;
+}
+
+inline int VectorField::brickIndex(int x,int y,int z) const
+{
+    int brick=(x>>brickBits)+(y>>brickBits)*xBricks+(z>>brickBits)*xBricks*yBricks;
+    int local=(x&(brickSize-1))+((y&(brickSize-1))<<brickBits)+((z&(brickSize-1))<<(2*brickBits));
+
+    return brickOffsets[brick]+local;
+}
+
+//corners are indexed as (dx<<2)|(dy<<1)|dz relative to the cell origin (x,y,z)
+void VectorField::fetchCell(int x,int y,int z,FVector corners[8]) const
+{
+    if(activeLayout==OutOfCoreLayout)
+    {
+        brickCache->fetchCell(x,y,z,&corners[0].x);
+        return;
+    }
+
+    if(activeLayout==LinearLayout)
+    {
+        const FVector *base=vectorField+x+y*xSize+z*xSize*ySize;
+        const int dy=xSize;
+        const int dz=xSize*ySize;
+
+        corners[0]=base[0];
+        corners[1]=base[dz];
+        corners[2]=base[dy];
+        corners[3]=base[dy+dz];
+        corners[4]=base[1];
+        corners[5]=base[1+dz];
+        corners[6]=base[1+dy];
+        corners[7]=base[1+dy+dz];
+
+        return;
+    }
+
+    int index[8];
+
+    const int mask=brickSize-1;
+
+    if((x&mask)!=mask && (y&mask)!=mask && (z&mask)!=mask)
+    {
+        //the whole cell lives inside one brick
+        const int base=brickIndex(x,y,z);
+        const int dy=brickSize;
+        const int dz=brickSize*brickSize;
+
+        index[0]=base;
+        index[1]=base+dz;
+        index[2]=base+dy;
+        index[3]=base+dy+dz;
+        index[4]=base+1;
+        index[5]=base+1+dz;
+        index[6]=base+1+dy;
+        index[7]=base+1+dy+dz;
+    }
+    else
+    {
+        for(int i=0;i<8;++i)
+            index[i]=brickIndex(x+((i>>2)&1),y+((i>>1)&1),z+(i&1));
+    }
+
+    switch(activeLayout)
+    {
+    case BrickedLayout:
+        for(int i=0;i<8;++i)
+            corners[i]=brickedField[index[i]];
+        break;
+
+    case HalfLayout:
+        for(int i=0;i<8;++i)
+        {
+            const unsigned short *v=packedField+index[i]*3;
+            corners[i].x=halfToFloat(v[0]);
+            corners[i].y=halfToFloat(v[1]);
+            corners[i].z=halfToFloat(v[2]);
+        }
+        break;
+
+    default:
+        for(int i=0;i<8;++i)
+        {
+            const unsigned short *v=packedField+index[i]*3;
+            const int slot=(index[i]>>(3*brickBits))*3;
+            corners[i].x=brickBias[slot]+v[0]*brickScale[slot];
+            corners[i].y=brickBias[slot+1]+v[1]*brickScale[slot+1];
+            corners[i].z=brickBias[slot+2]+v[2]*brickScale[slot+2];
+        }
+        break;
+    }
+}
+
+void VectorField::releasePyramid()
+{
+    for(size_t i=mappedLevels;i<pyramid.size();++i)
+        delete [] pyramid[i].field;
+
+    pyramid.clear();
+    mappedLevels=0;
+}
+
+void VectorField::getLevelSize(int level,int &x,int &y,int &z)
+{
+    if(level<=0 || pyramid.empty())
+    {
+        x=xSize;
+        y=ySize;
+        z=zSize;
+    }
+    else
+    {
+        const PyramidLevel &l=pyramid[qMin(level,(int)pyramid.size())-1];
+        x=l.xSize;
+        y=l.ySize;
+        z=l.zSize;
+    }
+}
+
+void VectorField::fetchLevelCell(int level,int x,int y,int z,FVector corners[8]) const
+{
+    if(level==0)
+    {
+        fetchCell(x,y,z,corners);
+        return;
+    }
+
+    const PyramidLevel &l=pyramid[level-1];
+
+    for(int i=0;i<8;++i)
+        corners[i]=l.field[(x+(i>>2&1))+(y+(i>>1&1))*l.xSize+(z+(i&1))*l.xSize*l.ySize];
+}
+
+void VectorField::downSampleSlice(PyramidSlice &slice)
+{
+    const VectorField *field=slice.owner;
+    const PyramidLevel &target=field->pyramid[slice.level-1];
+
+    if(field->loadCancelled)
+        return;
+
+    int fineX,fineY,fineZ;
+
+    if(slice.level==1)
+    {
+        fineX=field->xSize;
+        fineY=field->ySize;
+        fineZ=field->zSize;
+    }
+    else
+    {
+        fineX=field->pyramid[slice.level-2].xSize;
+        fineY=field->pyramid[slice.level-2].ySize;
+        fineZ=field->pyramid[slice.level-2].zSize;
+    }
+
+    FVector corners[8];
+
+    //the block of a voxel on an odd far face hangs over the border, its upper half replicates the last sample
+    int cz=qMin(slice.z*2,fineZ-2);
+    int z0=slice.z*2-cz;
+    int z1=qMin(z0+1,1);
+
+    for(int y=0;y<target.ySize;++y)
+    {
+        int cy=qMin(y*2,fineY-2);
+        int y0=y*2-cy;
+        int y1=qMin(y0+1,1);
+
+        for(int x=0;x<target.xSize;++x)
+        {
+            int cx=qMin(x*2,fineX-2);
+            int x0=x*2-cx;
+            int x1=qMin(x0+1,1);
+
+            field->fetchLevelCell(slice.level-1,cx,cy,cz,corners);
+
+            FVector &result=target.field[x+y*target.xSize+slice.z*target.xSize*target.ySize];
+            result.x=result.y=result.z=0.0f;
+
+            for(int i=0;i<8;++i)
+            {
+                const FVector &c=corners[(((i>>2&1)?x1:x0)<<2)|(((i>>1&1)?y1:y0)<<1)|((i&1)?z1:z0)];
+                result.x+=c.x;
+                result.y+=c.y;
+                result.z+=c.z;
+            }
+
+            result.x*=0.125f;
+            result.y*=0.125f;
+            result.z*=0.125f;
+        }
+    }
+}
+
+void VectorField::buildPyramid()
+{
+    int x=xSize;
+    int y=ySize;
+    int z=zSize;
+
+    //levels mapped from a container are kept, only the missing ones are computed
+    if(!pyramid.empty())
+        getLevelSize((int)pyramid.size(),x,y,z);
+
+    //every level needs at least one whole cell along each axis to be sampled
+    for(int level=(int)pyramid.size()+1;level<=pyramidLevels && x>=3 && y>=3 && z>=3 && !loadCancelled;++level)
+    {
+        PyramidLevel l;
+        l.xSize=x=(x+1)/2;
+        l.ySize=y=(y+1)/2;
+        l.zSize=z=(z+1)/2;
+        l.field=new FVector[x*y*z];
+
+        pyramid.push_back(l);
+
+        //level 1 reads the active layout, so the coarse levels are the same whatever the storage
+        QVector<PyramidSlice> slices(z);
+
+        for(int i=0;i<z;++i)
+        {
+            slices[i].owner=this;
+            slices[i].level=level;
+            slices[i].z=i;
+        }
+
+        QtConcurrent::blockingMap(slices,&VectorField::downSampleSlice);
+    }
+}
+
+void VectorField::ensureLevels(int level)
+{
+    if(level>0 && pyramid.empty() && activeLayout==OutOfCoreLayout)
+        buildPyramid();
+}
+
+void VectorField::getCellCorners(int level,int x,int y,int z,float corners[24]) const
+{
+	fetchLevelCell(qMin(level,(int)pyramid.size()),x,y,z,(FVector *)corners);
+}
 
 GGL::Point3f VectorField::getVector(float x,float y,float z)
 {
 
 	if(x>(float)(xSize-1) || x<0.0f || y>(float)(ySize-1) || y<0.0f || z<0.0f ||z>(float)(zSize-1))
 	{
-		FVector i1;
-		i1.x=0.0f;
-		i1.y=0.0f;
-		i1.z=0.0f;
                 return GGL::Point3f(0,0,0);
 	}
 
-	float xd=x-(int)x;
-	float yd=y-(int)y;
-	float zd=z-(int)z;
+	//a position on the far faces is treated as the end of the last cell so all 8 corners stay in range
+	int ix=qMin((int)x,xSize-2);
+	int iy=qMin((int)y,ySize-2);
+	int iz=qMin((int)z,zSize-2);
+
+	FVector corners[8];
+	fetchCell(ix,iy,iz,corners);
+
+	return interpolateCell(&corners[0].x,x-ix,y-iy,z-iz);
+}
+
+
+GGL::Point3f VectorField::getVectorAndJacobian(float x,float y,float z,float jacobian[3][3])
+{
+	for(int i=0;i<3;++i)
+		jacobian[i][0]=jacobian[i][1]=jacobian[i][2]=0.0f;
+
+	if(x>(float)(xSize-1) || x<0.0f || y>(float)(ySize-1) || y<0.0f || z<0.0f ||z>(float)(zSize-1))
+	{
+                return GGL::Point3f(0,0,0);
+	}
+
+	int ix=qMin((int)x,xSize-2);
+	int iy=qMin((int)y,ySize-2);
+	int iz=qMin((int)z,zSize-2);
+
+	float xd=x-ix;
+	float yd=y-iy;
+	float zd=z-iz;
 
 	float azd=1.0f-zd;
+	float ayd=1.0f-yd;
+	float axd=1.0f-xd;
+
+	FVector corners[8];
+	fetchCell(ix,iy,iz,corners);
+
+	const float *c=&corners[0].x;
+	float result[3];
+
+	//the same lerp tree as interpolateCell, each derivative swaps the lerp along its axis for a difference
+	for(int i=0;i<3;++i)
+	{
+		float i1=c[0+i]*azd+c[3+i]*zd;
+		float i2=c[6+i]*azd+c[9+i]*zd;
+		float j1=c[12+i]*azd+c[15+i]*zd;
+		float j2=c[18+i]*azd+c[21+i]*zd;
+
+		float w1=i1*ayd+i2*yd;
+		float w2=j1*ayd+j2*yd;
+
+		result[i]=w1*axd+w2*xd;
+
+		jacobian[i][0]=w2-w1;
+		jacobian[i][1]=(i2-i1)*axd+(j2-j1)*xd;
+		jacobian[i][2]=((c[3+i]-c[0+i])*ayd+(c[9+i]-c[6+i])*yd)*axd+((c[15+i]-c[12+i])*ayd+(c[21+i]-c[18+i])*yd)*xd;
+	}
 
-	FVector l=vectorField[(int)x + (int)y*xSize + (int)z*xSize*ySize];
-	FVector r=vectorField[(int)x + (int)y*xSize + ((int)z+1)*xSize*ySize];
+	return GGL::Point3f(result[0],result[1],result[2]);
+}
+
+GGL::Point3f VectorField::getVector(float x,float y,float z,int level)
+{
+	if(level<=0 || pyramid.empty())
+		return getVector(x,y,z);
 
-	FVector i1;
-	i1.x=l.x*azd+r.x*zd;
-	i1.y=l.y*azd+r.y*zd;
-	i1.z=l.z*azd+r.z*zd;
+	if(x>(float)(xSize-1) || x<0.0f || y>(float)(ySize-1) || y<0.0f || z<0.0f ||z>(float)(zSize-1))
+	{
+                return GGL::Point3f(0,0,0);
+	}
 
-	l=vectorField[(int)x + ((int)y+1)*xSize + (int)z*xSize*ySize];
-	r=vectorField[(int)x + ((int)y+1)*xSize + ((int)z+1)*xSize*ySize];
+	level=qMin(level,(int)pyramid.size());
 
-	FVector i2;
-	i2.x=l.x*azd+r.x*zd;
-	i2.y=l.y*azd+r.y*zd;
-	i2.z=l.z*azd+r.z*zd;
+	const PyramidLevel &l=pyramid[level-1];
 
+	//a coarse voxel sits at the center of the block it averages
+	float scale=(float)(1<<level);
+	float offset=0.5f*(scale-1.0f);
 
-	l=vectorField[(int)x+1 + (int)y*xSize + (int)z*xSize*ySize];
-	r=vectorField[(int)x+1 + (int)y*xSize + ((int)z+1)*xSize*ySize];
+	x=qBound(0.0f,(x-offset)/scale,(float)(l.xSize-1));
+	y=qBound(0.0f,(y-offset)/scale,(float)(l.ySize-1));
+	z=qBound(0.0f,(z-offset)/scale,(float)(l.zSize-1));
 
-	FVector j1;
-	j1.x=l.x*azd+r.x*zd;
-	j1.y=l.y*azd+r.y*zd;
-	j1.z=l.z*azd+r.z*zd;
+	int ix=qMin((int)x,l.xSize-2);
+	int iy=qMin((int)y,l.ySize-2);
+	int iz=qMin((int)z,l.zSize-2);
 
-	l=vectorField[(int)x+1 + ((int)y+1)*xSize + (int)z*xSize*ySize];
-	r=vectorField[(int)x+1 + ((int)y+1)*xSize + ((int)z+1)*xSize*ySize];
+	FVector corners[8];
+	fetchLevelCell(level,ix,iy,iz,corners);
 
-	FVector j2;
-	j2.x=l.x*azd+r.x*zd;
-	j2.y=l.y*azd+r.y*zd;
-	j2.z=l.z*azd+r.z*zd;
+	return interpolateCell(&corners[0].x,x-ix,y-iy,z-iz);
+}
 
+GGL::Point3f VectorField::getVectorAtTime(float x,float y,float z,float t)
+{
+	int steps=getStepCount();
 
-	FVector w1;
-	w1.x=i1.x*(1.0f-yd)+i2.x*yd;
-	w1.y=i1.y*(1.0f-yd)+i2.y*yd;
-	w1.z=i1.z*(1.0f-yd)+i2.z*yd;
+	if(steps<2)
+		return getVector(x,y,z);
 
-	FVector w2;
-	w2.x=j1.x*(1.0f-yd)+j2.x*yd;
-	w2.y=j1.y*(1.0f-yd)+j2.y*yd;
-	w2.z=j1.z*(1.0f-yd)+j2.z*yd;
+	if(x>(float)(xSize-1) || x<0.0f || y>(float)(ySize-1) || y<0.0f || z<0.0f ||z>(float)(zSize-1))
+	{
+                return GGL::Point3f(0,0,0);
+	}
 
-	FVector result;	
-	result.x=w1.x*(1.0f-xd)+w2.x*xd;
-	result.y=w1.y*(1.0f-xd)+w2.y*xd;
-	result.z=w1.z*(1.0f-xd)+w2.z*xd;
+	t=qBound(0.0f,t,(float)(steps-1));
 
-        return GGL::Point3f(result.x,result.y,result.z);
+	int frame=qMin((int)t,steps-2);
+
+	const float *from=frameRing->acquire(frame);
+	const float *to=frameRing->acquire(frame+1);
+
+	GGL::Point3f result=getVectorBetweenFrames(from,to,x,y,z,t-frame);
+
+	frameRing->release(frame);
+	frameRing->release(frame+1);
+
+	return result;
 }
 
+GGL::Point3f VectorField::getVectorBetweenFrames(const float *from,const float *to,float x,float y,float z,float s) const
+{
+	if(x>(float)(xSize-1) || x<0.0f || y>(float)(ySize-1) || y<0.0f || z<0.0f ||z>(float)(zSize-1))
+	{
+                return GGL::Point3f(0,0,0);
+	}
+
+	int ix=qMin((int)x,xSize-2);
+	int iy=qMin((int)y,ySize-2);
+	int iz=qMin((int)z,zSize-2);
+
+	float corners[2][24];
+	const float *frames[2]={from,to};
+
+	//frames are kept as plain x-fastest arrays whatever the storage layout of the steady field
+	for(int f=0;f<2;++f)
+		for(int i=0;i<8;++i)
+		{
+			const float *v=frames[f]+3*((ix+(i>>2&1))+(iy+(i>>1&1))*xSize+(iz+(i&1))*xSize*ySize);
+
+			corners[f][i*3]=v[0];
+			corners[f][i*3+1]=v[1];
+			corners[f][i*3+2]=v[2];
+		}
+
+	return interpolateCell(corners[0],x-ix,y-iy,z-iz)*(1.0f-s)+interpolateCell(corners[1],x-ix,y-iy,z-iz)*s;
+}
+
+#ifdef VECTORFIELD_SSE
+
+static inline __m128 lerp4(__m128 a,__m128 b,__m128 t,__m128 at)
+{
+	return _mm_add_ps(_mm_mul_ps(a,at),_mm_mul_ps(b,t));
+}
+
+#endif
+
+void VectorField::getVectors(int count,const float *x,const float *y,const float *z,float *vx,float *vy,float *vz)
+{
+	int i=0;
+
+#ifdef VECTORFIELD_SSE
+	const __m128 zero=_mm_setzero_ps();
+	const __m128 one=_mm_set1_ps(1.0f);
+	const __m128 upperX=_mm_set1_ps((float)(xSize-1));
+	const __m128 upperY=_mm_set1_ps((float)(ySize-1));
+	const __m128 upperZ=_mm_set1_ps((float)(zSize-1));
+	const __m128 lastCellX=_mm_set1_ps((float)(xSize-2));
+	const __m128 lastCellY=_mm_set1_ps((float)(ySize-2));
+	const __m128 lastCellZ=_mm_set1_ps((float)(zSize-2));
+
+	float *out[3]={vx,vy,vz};
+
+	for(;i+4<=count;i+=4)
+	{
+		__m128 px=_mm_loadu_ps(x+i);
+		__m128 py=_mm_loadu_ps(y+i);
+		__m128 pz=_mm_loadu_ps(z+i);
+
+		__m128 inside=_mm_and_ps(_mm_and_ps(_mm_cmpge_ps(px,zero),_mm_cmple_ps(px,upperX)),
+		                         _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(py,zero),_mm_cmple_ps(py,upperY)),
+		                                    _mm_and_ps(_mm_cmpge_ps(pz,zero),_mm_cmple_ps(pz,upperZ))));
+
+		//lanes outside the field are clamped so their fetch stays valid, the mask zeroes them afterwards
+		px=_mm_min_ps(_mm_max_ps(px,zero),upperX);
+		py=_mm_min_ps(_mm_max_ps(py,zero),upperY);
+		pz=_mm_min_ps(_mm_max_ps(pz,zero),upperZ);
+
+		__m128 cx=_mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(px)),lastCellX);
+		__m128 cy=_mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(py)),lastCellY);
+		__m128 cz=_mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(pz)),lastCellZ);
+
+		int ix[4],iy[4],iz[4];
+		_mm_storeu_si128((__m128i *)ix,_mm_cvttps_epi32(cx));
+		_mm_storeu_si128((__m128i *)iy,_mm_cvttps_epi32(cy));
+		_mm_storeu_si128((__m128i *)iz,_mm_cvttps_epi32(cz));
+
+		FVector corners[4][8];
+
+		for(int lane=0;lane<4;++lane)
+			fetchCell(ix[lane],iy[lane],iz[lane],corners[lane]);
+
+		__m128 xd=_mm_sub_ps(px,cx);
+		__m128 yd=_mm_sub_ps(py,cy);
+		__m128 zd=_mm_sub_ps(pz,cz);
+		__m128 axd=_mm_sub_ps(one,xd);
+		__m128 ayd=_mm_sub_ps(one,yd);
+		__m128 azd=_mm_sub_ps(one,zd);
+
+		for(int c=0;c<3;++c)
+		{
+			__m128 v[8];
+
+			for(int k=0;k<8;++k)
+				v[k]=_mm_set_ps((&corners[3][k].x)[c],(&corners[2][k].x)[c],(&corners[1][k].x)[c],(&corners[0][k].x)[c]);
+
+			__m128 i1=lerp4(v[0],v[1],zd,azd);
+			__m128 i2=lerp4(v[2],v[3],zd,azd);
+			__m128 j1=lerp4(v[4],v[5],zd,azd);
+			__m128 j2=lerp4(v[6],v[7],zd,azd);
+
+			__m128 w1=lerp4(i1,i2,yd,ayd);
+			__m128 w2=lerp4(j1,j2,yd,ayd);
+
+			_mm_storeu_ps(out[c]+i,_mm_and_ps(lerp4(w1,w2,xd,axd),inside));
+		}
+	}
+#endif
+
+	for(;i<count;++i)
+	{
+		GGL::Point3f v=getVector(x[i],y[i],z[i]);
+
+		vx[i]=v.X();
+		vy[i]=v.Y();
+		vz[i]=v.Z();
+	}
+}
 
 GGL::Point3f VectorField::getCenter()
 {
@@ -135,43 +1497,30 @@ float VectorField::getRadius()
 
 void VectorField::draw()
 {
-
 	glDisable(GL_LIGHTING);
-	
+
 	glColor3ub(0, 0, 0);
-	
-	glBegin(GL_LINE_STRIP);
-	
-	glVertex3f(0.0f,0.0f,0.0f);
-	glVertex3f(0.0f, 0.0f, zSize);
-	
-	glVertex3f(0.0f,ySize,zSize);
-	glVertex3f(0.0f, ySize, 0.0f);
-	
-	glVertex3f(0.0f, 0.0f, 0.0f);
 
-	glVertex3f(xSize, 0.0f, 0.0f);
-	
-	glVertex3f(xSize, 0.0f, zSize);
-	
-	glVertex3f(xSize, ySize, zSize);
-	
-	glVertex3f(xSize, ySize, 0.0f);
-	
-	glVertex3f(xSize, 0.0f, 0.0f);
-	
-	glEnd();
-	
-	glBegin(GL_LINES);
-	glVertex3f(0.0f, ySize, 0.0f);
-	glVertex3f(xSize, ySize, 0.0f);
-	
-	glVertex3f(0.0f, 0.0f, zSize);
-	glVertex3f(xSize, 0.0f, zSize);
-	
-	glVertex3f(0.0f, ySize, zSize);
-	glVertex3f(xSize, ySize, zSize);
-	glEnd();
+	if(!boxBuffer.isCurrent(generation))
+	{
+		float x=(float)xSize;
+		float y=(float)ySize;
+		float z=(float)zSize;
 
-	
+		//the 12 edges of the field's bounding box
+		float edges[24][3]={{0,0,0},{x,0,0}, {0,y,0},{x,y,0}, {0,0,z},{x,0,z}, {0,y,z},{x,y,z},
+		                    {0,0,0},{0,y,0}, {x,0,0},{x,y,0}, {0,0,z},{0,y,z}, {x,0,z},{x,y,z},
+		                    {0,0,0},{0,0,z}, {x,0,0},{x,0,z}, {0,y,0},{0,y,z}, {x,y,0},{x,y,z}};
+
+		boxBuffer.upload(generation,edges,sizeof(edges));
+	}
+
+	boxBuffer.bind();
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3,GL_FLOAT,0,bufferOffset(0));
+
+	glDrawArrays(GL_LINES,0,24);
+
+	glDisableClientState(GL_VERTEX_ARRAY);
+	boxBuffer.unbind();
 }
@@ -2,14 +2,25 @@
 #define __VectorField__
 
 #include <QtCore/QObject>
+#include <QtCore/QFile>
+#include <QtCore/QAtomicInt>
+#include <vector>
 #include "Point3.h"
+#include "fieldreader.h"
+#include "fieldcontainer.h"
+#include "vertexbuffer.h"
 
+class BrickCache;
+class FrameRing;
 
 class VectorField:public QObject
 {
 
     Q_OBJECT
 
+    //loads into a private staging field on its own thread and publishes it when complete
+    friend class FieldLoader;
+
     struct FVector
     {
     float x;
@@ -29,6 +40,182 @@ class VectorField:public QObject
 private:
     QString dataName;
 
+    //the .vec file is mapped instead of copied, vectorField then points straight into the mapping
+    QFile *mappedFile;
+    uchar *mappedData;
+    bool ownsField;
+
+    void release();
+    void releaseSource();
+    void releaseMapping();
+    void computeMagnitudeRange();
+
+public:
+    //LinearLayout samples the x-fastest array directly, the other layouts re-lay the field into
+    //brickSize^3 bricks placed along a Z-order curve so the 8 corners of a cell share a brick.
+    //HalfLayout and QuantizedLayout keep 16 bit components (per brick scale and bias for the latter)
+    //and decode them on the fly. OutOfCoreLayout streams bricks from a brick file through a BrickCache.
+    enum StorageLayout {LinearLayout, BrickedLayout, HalfLayout, QuantizedLayout, OutOfCoreLayout};
+
+    //takes effect on the next init
+    void setStorageLayout(StorageLayout _layout)
+    {
+        storageLayout=_layout;
+    };
+
+    StorageLayout getStorageLayout()
+    {
+        return activeLayout;
+    };
+
+    QString getStorageInfo();
+
+    //memory budget of the out-of-core brick cache, takes effect on the next init
+    void setBrickCacheBudget(int megabytes)
+    {
+        cacheBudget=megabytes;
+    };
+
+    //hints the out-of-core cache that a tracer at pos is heading along dir, a no-op for in-core layouts
+    void prefetch(const GGL::Point3f &pos,const GGL::Point3f &dir);
+
+    //largest component error introduced by the active layout
+    float storageError;
+
+    //coarse levels of the multi-resolution pyramid built at load time, 0 disables it, takes effect on the next init
+    void setPyramidLevels(int levels)
+    {
+        pyramidLevels=levels;
+    };
+
+    //Out-of-core storage skips the pyramid at load time, building it streams the whole dataset.
+    //The first call asking for a level above 0 builds it. Call it on the GUI thread before tracing
+    //at that level, never from a sampler thread.
+    void ensureLevels(int level);
+
+    //level 0 is the full resolution field, level n halves every dimension n times
+    int getLevelCount()
+    {
+        return (int)pyramid.size()+1;
+    };
+
+    void getLevelSize(int level,int &x,int &y,int &z);
+
+    //frames of a time series kept resident at once, takes effect on the next initSeries
+    void setFrameRingSize(int frames)
+    {
+        frameRingSize=frames;
+    };
+
+    //1 for a steady field
+    int getStepCount();
+
+    //pins frame 0..getStepCount()-1 of a time series as x-fastest xyz floats, valid until the
+    //matching releaseFrame. Tracers that sweep time read each frame once this way.
+    const float *acquireFrame(int frame);
+    void releaseFrame(int frame);
+
+    //writes the loaded field as a .vfc container with its magnitude range, per brick ranges, the
+    //pyramid and, with withBricks, a Z-order bricked copy that BrickedLayout maps as it is
+    bool saveContainer(const QString &filename,bool withBricks=true);
+
+    //loads a raw .vec file with its own settings and writes it as a container
+    static bool convertToContainer(const char *source,const FieldFormat &format,int _sizex,int _sizey,int _sizez,const QString &target);
+
+    //the dimensions recorded in a container, false for anything else
+    static bool getContainerSize(const char *filename,int &x,int &y,int &z);
+
+    //magnitude range of the brick around a point, only known for fields loaded from a container
+    bool getBrickMagnitudeRange(float x,float y,float z,float &low,float &high);
+
+    //element type, byte order and clamping of the files read by the next init, anything but native
+    //floats is converted while streaming the file instead of being mapped
+    void setSourceFormat(const FieldFormat &format)
+    {
+        sourceFormat=format;
+    };
+
+private:
+    enum {brickBits=3, brickSize=1<<brickBits, brickVoxels=brickSize*brickSize*brickSize};
+
+    StorageLayout storageLayout;
+    StorageLayout activeLayout;
+
+    struct FVector *brickedField;
+    unsigned short *packedField;
+    float *brickScale;
+    float *brickBias;
+    int *brickOffsets;
+    int xBricks;
+    int yBricks;
+    int zBricks;
+
+    BrickCache *brickCache;
+    int cacheBudget;
+
+    bool openBrickCache(const char *filename,const FieldFormat &format,qint64 firstVector);
+    void buildBrickOrder();
+    static void mortonBrickOffsets(int _xBricks,int _yBricks,int _zBricks,int *offsets);
+    void gatherBrick(int bx,int by,int bz,FVector *target) const;
+    void buildLayout();
+    inline int brickIndex(int x,int y,int z) const;
+    void fetchCell(int x,int y,int z,FVector corners[8]) const;
+
+    //each coarse voxel is the box filtered 2x2x2 block below it, kept as a plain x-fastest array
+    struct PyramidLevel
+    {
+        int xSize;
+        int ySize;
+        int zSize;
+        struct FVector *field;
+    };
+
+    struct PyramidSlice
+    {
+        VectorField *owner;
+        int level;
+        int z;
+    };
+
+    std::vector<PyramidLevel> pyramid;
+    int pyramidLevels;
+
+    //sections served straight from a mapped .vfc container, never deleted
+    bool mappedBricks;
+    int mappedLevels;
+    const float *brickMagnitudes;
+
+    bool mapContainer(const char *filename,const FieldContainerHeader &header);
+    FVector fetchVoxel(int x,int y,int z) const;
+
+    void buildPyramid();
+    void releasePyramid();
+    void fetchLevelCell(int level,int x,int y,int z,FVector corners[8]) const;
+    static void downSampleSlice(PyramidSlice &slice);
+
+    FrameRing *frameRing;
+    int frameRingSize;
+
+    FieldFormat sourceFormat;
+
+    //set from another thread to abandon an init between two phases, the field is left empty
+    volatile bool loadCancelled;
+
+    //a field with the singleton's settings that nothing else sees until publish
+    static VectorField *createStaging();
+    bool loadAborted();
+
+    //swaps the contents of a loaded staging field into this one, emits dataUpdated and deletes the
+    //staging field together with the old data. Must run on the thread that reads the field.
+    void publish(VectorField *staging);
+
+    //jobs sampling the field off the GUI thread, FieldLoader holds a finished load back while any run
+    QAtomicInt backgroundReads;
+
+    //bumped by every publish, the bounding box buffer is refilled when it falls behind
+    unsigned int generation;
+    VertexBuffer boxBuffer;
+
 public:
 
     QString getDataName()
@@ -36,6 +223,18 @@ public:
         return dataName;
     };
 
+    //A job that samples the field on a worker thread calls beginBackgroundRead on the GUI thread
+    //before it starts and endBackgroundRead, from any thread, once it no longer reads. A load that
+    //completes meanwhile is published only after the last read has ended, publish would otherwise
+    //swap and free the storage under the job.
+    void beginBackgroundRead();
+    void endBackgroundRead();
+
+    bool isReadInBackground()
+    {
+        return backgroundReads!=0;
+    };
+
 	float deltaT;
 	float maxMag;
 	float minMag;
@@ -59,9 +258,61 @@ public:
 	
         void init(const char *filename,int _sizex,int _sizey,int _sizez,const QString & dataName);
 
+        //a time-varying field of stepCount frames, see FrameRing for how pattern names them. The first
+        //frame is also loaded as the steady field, so everything that ignores time keeps working.
+        void initSeries(const QString &pattern,int firstStep,int stepCount,int _sizex,int _sizey,int _sizez,const QString & dataName);
+
 
         GGL::Point3f getVector(float x,float y,float z);
 
+        //same full resolution coordinates, sampled from a coarser pyramid level
+        GGL::Point3f getVector(float x,float y,float z,int level);
+
+        //the 8 corners of cell (x,y,z) of a level as 24 floats ordered (dx<<2)|(dy<<1)|dz, the cell
+        //must lie inside the level, see getLevelSize
+        void getCellCorners(int level,int x,int y,int z,float corners[24]) const;
+
+        //trilinear interpolation of corners as returned by getCellCorners at local coordinates 0..1
+        static inline GGL::Point3f interpolateCell(const float *corners,float xd,float yd,float zd)
+        {
+                float azd=1.0f-zd;
+                float ayd=1.0f-yd;
+                float axd=1.0f-xd;
+
+                float result[3];
+
+                for(int i=0;i<3;++i)
+                {
+                        float i1=corners[0+i]*azd+corners[3+i]*zd;
+                        float i2=corners[6+i]*azd+corners[9+i]*zd;
+                        float j1=corners[12+i]*azd+corners[15+i]*zd;
+                        float j2=corners[18+i]*azd+corners[21+i]*zd;
+
+                        float w1=i1*ayd+i2*yd;
+                        float w2=j1*ayd+j2*yd;
+
+                        result[i]=w1*axd+w2*xd;
+                }
+
+                return GGL::Point3f(result[0],result[1],result[2]);
+        };
+
+        //t is in frames from 0 to getStepCount()-1, linear between the two frames around it.
+        //Not a getVector overload so an integer frame can never be taken for a pyramid level.
+        //Pins and releases both frames on every call, for single queries only.
+        GGL::Point3f getVectorAtTime(float x,float y,float z,float t);
+
+        //the same between two frames pinned with acquireFrame, s from 0 at from to 1 at to. Loops
+        //pin the frames once and sample through this, as UnsteadyTracer does for a slab.
+        GGL::Point3f getVectorBetweenFrames(const float *from,const float *to,float x,float y,float z,float s) const;
+
+        //the vector plus its exact trilinear partial derivatives from the same 8 corners,
+        //jacobian[i][j] is the derivative of component i along axis j
+        GGL::Point3f getVectorAndJacobian(float x,float y,float z,float jacobian[3][3]);
+
+        //samples count points given as separate coordinate arrays, SSE lanes when available and getVector otherwise
+        void getVectors(int count,const float *x,const float *y,const float *z,float *vx,float *vy,float *vz);
+
 	void draw();
 	
         GGL::Point3f getCenter();
@@ -69,18 +320,16 @@ public:
 
 
 private:
-        VectorField():deltaT(0.8f),maxMag(-1.0f),minMag(10000000000.0f),colorSize(8),vectorField(NULL),xSize(0),ySize(0),zSize(0)
+        VectorField():mappedFile(NULL),mappedData(NULL),ownsField(false),storageError(0.0f),storageLayout(LinearLayout),activeLayout(LinearLayout),brickedField(NULL),packedField(NULL),brickScale(NULL),brickBias(NULL),brickOffsets(NULL),xBricks(0),yBricks(0),zBricks(0),brickCache(NULL),cacheBudget(256),pyramidLevels(4),mappedBricks(false),mappedLevels(0),brickMagnitudes(NULL),frameRing(NULL),frameRingSize(4),loadCancelled(false),generation(0),deltaT(0.8f),maxMag(-1.0f),minMag(10000000000.0f),colorSize(8),vectorField(NULL),xSize(0),ySize(0),zSize(0)
         {
 
         }
-        ~VectorField(void)
-        {
-                if(vectorField)
-                        delete [] vectorField;
-        }
+        ~VectorField(void);
 
          signals:
                 void dataUpdated();
+                void loadProgress(int percent);
+                void backgroundReadsEnded();
 };
 
 #endif
@@ -110,7 +110,23 @@ StreamLine.cpp \
     clustercolordialog.cpp \
     clustercolorscheme.cpp \
     seedingideadata.cpp \
-    autoseedingdialog.cpp
+    autoseedingdialog.cpp \
+    brickcache.cpp \
+    framering.cpp \
+    fieldloader.cpp \
+    fieldreader.cpp \
+    fieldcontainer.cpp \
+    streamlinetracer.cpp \
+    evenlyspacedseeder.cpp \
+    streamlinestore.cpp \
+    vertexbuffer.cpp \
+    packettracer.cpp \
+    unsteadytracer.cpp \
+    earlytermination.cpp \
+    streamlinefile.cpp \
+    streamlineclustering.cpp \
+    clusterresultfile.cpp \
+    streamlineresampler.cpp
 
 
 
@@ -220,6 +236,23 @@ StreamLine.h \
     clustercolordialog.h \
     clustercolorscheme.h \
     seedingideadata.h \
-    autoseedingdialog.h
+    autoseedingdialog.h \
+    brickcache.h \
+    framering.h \
+    fieldloader.h \
+    fieldreader.h \
+    fieldcontainer.h \
+    streamlinetracer.h \
+    integrator.h \
+    evenlyspacedseeder.h \
+    streamlinestore.h \
+    vertexbuffer.h \
+    packettracer.h \
+    unsteadytracer.h \
+    earlytermination.h \
+    streamlinefile.h \
+    streamlineclustering.h \
+    clusterresultfile.h \
+    streamlineresampler.h
 
 CUDA_SOURCES += cuda.cu
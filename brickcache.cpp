@@ -0,0 +1,418 @@
+#include "brickcache.h"
+#include <math.h>
+#include <string.h>
+#include <QtCore/QDateTime>
+#include <QtCore/QFileInfo>
+#include <QtCore/QtConcurrentRun>
+
+struct BrickFileHeader
+{
+    char magic[4];
+    int xSize;
+    int ySize;
+    int zSize;
+    float minMag;
+    float maxMag;
+    int formatTag;
+    int reserved;
+    //size and modification time of the source, an edited dataset gets its bricks rebuilt
+    qint64 sourceBytes;
+    qint64 sourceModified;
+};
+
+BrickCache::BrickCache():xSize(0),ySize(0),zSize(0),xBricks(0),yBricks(0),zBricks(0),slotCount(0),usedSlots(0),slotData(NULL),mostRecent(-1),leastRecent(-1),
+    outstanding(0),hits(0),misses(0),prefetched(0),minMag(10000000000.0f),maxMag(-1.0f)
+{
+}
+
+BrickCache::~BrickCache()
+{
+    close();
+}
+
+qint64 BrickCache::headerBytes()
+{
+    return sizeof(BrickFileHeader);
+}
+
+qint64 BrickCache::brickBytes()
+{
+    return brickVoxels*3*sizeof(float);
+}
+
+void BrickCache::sourceStamp(const char *source,qint64 &bytes,qint64 &modified)
+{
+    QFileInfo info(source);
+
+    bytes=info.size();
+    modified=info.lastModified().toTime_t();
+}
+
+bool BrickCache::buildBrickFile(const char *source,const FieldFormat &format,const QString &target,int _xSize,int _ySize,int _zSize,qint64 firstVector,const volatile bool *cancelled)
+{
+    FieldReader reader(format);
+
+    if(!reader.open(source,firstVector))
+        return false;
+
+    QFile out(target);
+
+    if(!out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    BrickFileHeader header;
+    memcpy(header.magic,"VFB2",4);
+    header.xSize=_xSize;
+    header.ySize=_ySize;
+    header.zSize=_zSize;
+    header.minMag=10000000000.0f;
+    header.maxMag=-1.0f;
+    header.formatTag=format.tag();
+    header.reserved=0;
+    sourceStamp(source,header.sourceBytes,header.sourceModified);
+
+    out.write((const char *)&header,sizeof(header));
+
+    int _xBricks=(_xSize+brickSize-1)>>brickBits;
+    int _yBricks=(_ySize+brickSize-1)>>brickBits;
+    int _zBricks=(_zSize+brickSize-1)>>brickBits;
+
+    //one row of bricks needs brickSize z slices of the raw file, nothing more is ever resident
+    std::vector<float> slab((size_t)brickSize*_xSize*_ySize*3);
+    std::vector<float> brick(brickVoxels*3);
+
+    bool result=true;
+
+    for(int bz=0;bz<_zBricks && result;++bz)
+    {
+        if(cancelled && *cancelled)
+        {
+            result=false;
+            break;
+        }
+
+        int planes=qMin((int)brickSize,_zSize-(bz<<brickBits));
+
+        if(reader.read(&slab[0],planes*_xSize*_ySize)!=planes*_xSize*_ySize)
+        {
+            result=false;
+            break;
+        }
+
+        for(int i=0;i<planes*_xSize*_ySize;++i)
+        {
+            const float *v=&slab[i*3];
+            float mag=sqrt(v[0]*v[0]+v[1]*v[1]+v[2]*v[2]);
+
+            if(mag>header.maxMag)
+                header.maxMag=mag;
+
+            if(mag<header.minMag)
+                header.minMag=mag;
+        }
+
+        for(int by=0;by<_yBricks;++by)
+            for(int bx=0;bx<_xBricks;++bx)
+            {
+                //voxels hanging over the border replicate the last sample so a brick is always complete
+                for(int lz=0;lz<brickSize;++lz)
+                    for(int ly=0;ly<brickSize;++ly)
+                        for(int lx=0;lx<brickSize;++lx)
+                        {
+                            int x=qMin((bx<<brickBits)+lx,_xSize-1);
+                            int y=qMin((by<<brickBits)+ly,_ySize-1);
+                            int z=qMin(lz,planes-1);
+
+                            memcpy(&brick[(lx+(ly<<brickBits)+(lz<<(2*brickBits)))*3],&slab[(x+y*_xSize+z*_xSize*_ySize)*3],sizeof(float)*3);
+                        }
+
+                if(out.write((const char *)&brick[0],brickBytes())!=brickBytes())
+                    result=false;
+            }
+    }
+
+    out.seek(0);
+    out.write((const char *)&header,sizeof(header));
+    out.close();
+
+    //a short source or a cancel leaves no half brick file behind
+    if(!result)
+        QFile::remove(target);
+
+    return result;
+}
+
+bool BrickCache::open(const QString &filename,const char *source,int formatTag,int _xSize,int _ySize,int _zSize,int budgetMegabytes)
+{
+    close();
+
+    brickFile.setFileName(filename);
+
+    if(!brickFile.open(QIODevice::ReadOnly))
+        return false;
+
+    BrickFileHeader header;
+    qint64 sourceBytes=0;
+    qint64 sourceModified=0;
+
+    sourceStamp(source,sourceBytes,sourceModified);
+
+    if(brickFile.read((char *)&header,sizeof(header))!=sizeof(header) || memcmp(header.magic,"VFB2",4)!=0
+        || header.xSize!=_xSize || header.ySize!=_ySize || header.zSize!=_zSize || header.formatTag!=formatTag
+        || header.sourceBytes!=sourceBytes || header.sourceModified!=sourceModified)
+    {
+        brickFile.close();
+        return false;
+    }
+
+    xSize=_xSize;
+    ySize=_ySize;
+    zSize=_zSize;
+    xBricks=(xSize+brickSize-1)>>brickBits;
+    yBricks=(ySize+brickSize-1)>>brickBits;
+    zBricks=(zSize+brickSize-1)>>brickBits;
+
+    int brickCount=xBricks*yBricks*zBricks;
+
+    if(brickFile.size()<headerBytes()+brickCount*brickBytes())
+    {
+        brickFile.close();
+        return false;
+    }
+
+    minMag=header.minMag;
+    maxMag=header.maxMag;
+
+    //a cell can straddle 8 bricks, so that many slots are kept whatever the budget says
+    slotCount=(int)((qint64)budgetMegabytes*1024*1024/brickBytes());
+    slotCount=qBound(8,slotCount,brickCount);
+    slotData=new float[slotCount*brickVoxels*3];
+
+    brickSlot.assign(brickCount,-1);
+    pending.assign(brickCount,false);
+    slotBrick.assign(slotCount,-1);
+    prevSlot.assign(slotCount,-1);
+    nextSlot.assign(slotCount,-1);
+    slotLoading.assign(slotCount,false);
+    mostRecent=-1;
+    leastRecent=-1;
+    usedSlots=0;
+
+    hits=misses=prefetched=0;
+
+    return true;
+}
+
+void BrickCache::close()
+{
+    mutex.lock();
+
+    while(outstanding>0)
+        prefetchDone.wait(&mutex);
+
+    mutex.unlock();
+
+    if(brickFile.isOpen())
+        brickFile.close();
+
+    delete [] slotData;
+    slotData=NULL;
+    slotCount=0;
+    usedSlots=0;
+
+    brickSlot.clear();
+    slotBrick.clear();
+    prevSlot.clear();
+    nextSlot.clear();
+    slotLoading.clear();
+    pending.clear();
+}
+
+void BrickCache::touch(int slot)
+{
+    if(slot==mostRecent)
+        return;
+
+    //unlink
+    if(prevSlot[slot]>=0)
+        nextSlot[prevSlot[slot]]=nextSlot[slot];
+
+    if(nextSlot[slot]>=0)
+        prevSlot[nextSlot[slot]]=prevSlot[slot];
+
+    if(leastRecent==slot)
+        leastRecent=nextSlot[slot];
+
+    //append as most recent
+    prevSlot[slot]=mostRecent;
+    nextSlot[slot]=-1;
+
+    if(mostRecent>=0)
+        nextSlot[mostRecent]=slot;
+
+    mostRecent=slot;
+
+    if(leastRecent<0)
+        leastRecent=slot;
+}
+
+int BrickCache::claimSlot()
+{
+    //slots are handed out in order until the budget is used up, after that the LRU slot that is
+    //not being read is recycled
+    if(usedSlots<slotCount)
+        return usedSlots++;
+
+    for(int slot=leastRecent;slot>=0;slot=nextSlot[slot])
+        if(!slotLoading[slot])
+        {
+            brickSlot[slotBrick[slot]]=-1;
+            return slot;
+        }
+
+    return -1;
+}
+
+int BrickCache::loadBrick(int brick,QMutexLocker &locker)
+{
+    int slot;
+
+    //every slot is being read by another thread, wait for one of them
+    while((slot=claimSlot())<0)
+        brickLoaded.wait(&mutex);
+
+    //the brick is claimed before the read, so a second miss on it waits instead of reading it again
+    slotBrick[slot]=brick;
+    brickSlot[brick]=slot;
+    slotLoading[slot]=true;
+
+    touch(slot);
+
+    float *target=slotData+slot*brickVoxels*3;
+
+    locker.unlock();
+
+    fileMutex.lock();
+    brickFile.seek(headerBytes()+brick*brickBytes());
+
+    if(brickFile.read((char *)target,brickBytes())!=brickBytes())
+        memset(target,0,brickBytes());
+
+    fileMutex.unlock();
+
+    locker.relock();
+
+    slotLoading[slot]=false;
+    brickLoaded.wakeAll();
+
+    return slot;
+}
+
+int BrickCache::getResidentBricks()
+{
+    QMutexLocker locker(&mutex);
+    return usedSlots;
+}
+
+const float *BrickCache::brickData(int brick,QMutexLocker &locker)
+{
+    int slot=brickSlot[brick];
+
+    //a brick another thread is reading counts as a hit, it is only read once
+    while(slot>=0 && slotLoading[slot])
+    {
+        brickLoaded.wait(&mutex);
+        slot=brickSlot[brick];
+    }
+
+    if(slot>=0)
+    {
+        ++hits;
+        touch(slot);
+    }
+    else
+    {
+        ++misses;
+        slot=loadBrick(brick,locker);
+    }
+
+    return slotData+slot*brickVoxels*3;
+}
+
+void BrickCache::fetchCell(int x,int y,int z,float *corners)
+{
+    QMutexLocker locker(&mutex);
+
+    const int mask=brickSize-1;
+
+    if((x&mask)!=mask && (y&mask)!=mask && (z&mask)!=mask)
+    {
+        const float *data=brickData((x>>brickBits)+(y>>brickBits)*xBricks+(z>>brickBits)*xBricks*yBricks,locker);
+        const float *base=data+((x&mask)+((y&mask)<<brickBits)+((z&mask)<<(2*brickBits)))*3;
+
+        for(int i=0;i<8;++i)
+            memcpy(corners+i*3,base+((i>>2&1)+((i>>1&1)<<brickBits)+((i&1)<<(2*brickBits)))*3,sizeof(float)*3);
+    }
+    else
+    {
+        for(int i=0;i<8;++i)
+        {
+            int cx=x+(i>>2&1);
+            int cy=y+(i>>1&1);
+            int cz=z+(i&1);
+
+            //read right away, a later brickData may give the slot to another brick
+            const float *data=brickData((cx>>brickBits)+(cy>>brickBits)*xBricks+(cz>>brickBits)*xBricks*yBricks,locker);
+
+            memcpy(corners+i*3,data+((cx&mask)+((cy&mask)<<brickBits)+((cz&mask)<<(2*brickBits)))*3,sizeof(float)*3);
+        }
+    }
+}
+
+void BrickCache::prefetch(float x,float y,float z,float dx,float dy,float dz)
+{
+    float length=sqrt(dx*dx+dy*dy+dz*dz);
+
+    if(length<=0.0f || !slotData)
+        return;
+
+    //look one brick ahead along the direction of travel
+    float ahead=brickSize/length;
+
+    int px=(int)(x+dx*ahead);
+    int py=(int)(y+dy*ahead);
+    int pz=(int)(z+dz*ahead);
+
+    if(px<0 || py<0 || pz<0 || px>=xSize || py>=ySize || pz>=zSize)
+        return;
+
+    int brick=(px>>brickBits)+(py>>brickBits)*xBricks+(pz>>brickBits)*xBricks*yBricks;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        if(brickSlot[brick]>=0 || pending[brick])
+            return;
+
+        pending[brick]=true;
+        ++outstanding;
+    }
+
+    QtConcurrent::run(this,&BrickCache::prefetchBrick,brick);
+}
+
+void BrickCache::prefetchBrick(int brick)
+{
+    QMutexLocker locker(&mutex);
+
+    if(brickSlot[brick]<0)
+    {
+        loadBrick(brick,locker);
+        ++prefetched;
+    }
+
+    pending[brick]=false;
+
+    --outstanding;
+    prefetchDone.wakeAll();
+}
@@ -0,0 +1,112 @@
+#ifndef BRICKCACHE_H
+#define BRICKCACHE_H
+
+#include <vector>
+#include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+#include <QtCore/QString>
+#include "fieldreader.h"
+
+//Serves an out-of-core vector field from a brick file on disk. Bricks are kept in an LRU cache
+//bounded by a memory budget, a miss reads the brick synchronously and prefetch() loads the bricks
+//ahead of a moving point on the global thread pool. All entry points are thread safe, the cache
+//lock is not held over a disk read so hits go on while a brick comes in.
+class BrickCache
+{
+public:
+    enum {brickBits=3, brickSize=1<<brickBits, brickVoxels=brickSize*brickSize*brickSize};
+
+private:
+    QFile brickFile;
+    //seek and read of brickFile, taken without mutex held
+    QMutex fileMutex;
+    QMutex mutex;
+    QWaitCondition prefetchDone;
+    QWaitCondition brickLoaded;
+
+    int xSize;
+    int ySize;
+    int zSize;
+    int xBricks;
+    int yBricks;
+    int zBricks;
+
+    int slotCount;
+    int usedSlots;
+    float *slotData;
+
+    //brick -> slot or -1, slot -> brick or -1, LRU order is a doubly linked list over the slots
+    std::vector<int> brickSlot;
+    std::vector<int> slotBrick;
+    std::vector<int> prevSlot;
+    std::vector<int> nextSlot;
+    //a slot being read is neither served nor recycled until its read is done
+    std::vector<bool> slotLoading;
+    int mostRecent;
+    int leastRecent;
+
+    std::vector<bool> pending;
+    int outstanding;
+
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int prefetched;
+
+    void touch(int slot);
+    int claimSlot();
+    int loadBrick(int brick,QMutexLocker &locker);
+    const float *brickData(int brick,QMutexLocker &locker);
+    void prefetchBrick(int brick);
+
+    static qint64 headerBytes();
+    static qint64 brickBytes();
+
+    static void sourceStamp(const char *source,qint64 &bytes,qint64 &modified);
+
+public:
+    BrickCache();
+    ~BrickCache();
+
+    //converts a raw x-fastest .vec file into a brick file in one streaming pass, the magnitude
+    //range is computed on the way and stored in the header so a reopen skips the pass.
+    //firstVector skips a header in front of the vectors, as in a .vfc container. Setting *cancelled
+    //stops the pass after the current row of bricks, the partial file is deleted.
+    static bool buildBrickFile(const char *source,const FieldFormat &format,const QString &target,int _xSize,int _ySize,int _zSize,qint64 firstVector=0,const volatile bool *cancelled=NULL);
+
+    //formatTag is FieldFormat::tag() of the source, a brick file converted differently or from a
+    //source whose size or modification time has changed since is refused
+    bool open(const QString &filename,const char *source,int formatTag,int _xSize,int _ySize,int _zSize,int budgetMegabytes);
+    void close();
+
+    float minMag;
+    float maxMag;
+
+    //24 floats, the corners ordered as (dx<<2)|(dy<<1)|dz
+    void fetchCell(int x,int y,int z,float *corners);
+
+    void prefetch(float x,float y,float z,float dx,float dy,float dz);
+
+    unsigned int getHits()
+    {
+        return hits;
+    };
+
+    unsigned int getMisses()
+    {
+        return misses;
+    };
+
+    unsigned int getPrefetched()
+    {
+        return prefetched;
+    };
+
+    int getResidentBricks();
+    int getBudgetBricks()
+    {
+        return slotCount;
+    };
+};
+
+#endif // BRICKCACHE_H
@@ -0,0 +1,156 @@
+#include "clusterresultfile.h"
+#include <string.h>
+#include <QtCore/QFile>
+
+bool writeClusterResultFile(const QString &filename,const ClusterResult &result,qint64 sourceBytes,qint64 sourceModified)
+{
+    int clusterCount=(int)result.clusterlist.size();
+
+    if((int)result.largestEntropy.size()!=clusterCount || (int)result.smallestEntropy.size()!=clusterCount)
+        return false;
+
+    std::vector<ClusterResultRecord> clusters(clusterCount);
+    std::vector<int> lines(1,0);
+
+    for(int c=0;c<clusterCount;++c)
+    {
+        const std::vector<StreamSampleLine> &aCluster=result.clusterlist[c];
+
+        clusters[c].firstLine=(int)lines.size()-1;
+        clusters[c].lineCount=(int)aCluster.size();
+        clusters[c].largestEntropy=result.largestEntropy[c];
+        clusters[c].smallestEntropy=result.smallestEntropy[c];
+        clusters[c].variation=c<(int)result.variations.size()?result.variations[c]:0.0f;
+        clusters[c].reserved=0;
+
+        for(size_t e=0;e<aCluster.size();++e)
+            lines.push_back(lines.back()+(int)aCluster[e].samples.size());
+    }
+
+    ClusterResultHeader header;
+    memset(&header,0,sizeof(header));
+    memcpy(header.magic,"CRF1",4);
+    header.version=clusterResultVersion;
+    header.byteOrder=clusterResultByteOrder;
+    header.clusterCount=clusterCount;
+    header.lineCount=(int)lines.size()-1;
+    header.pointCount=lines.back();
+    header.sourceBytes=sourceBytes;
+    header.sourceModified=sourceModified;
+    header.clusterOffset=sizeof(header);
+    header.lineOffset=header.clusterOffset+(qint64)clusterCount*sizeof(ClusterResultRecord);
+    header.pointOffset=header.lineOffset+(qint64)lines.size()*sizeof(int);
+
+    QFile file(filename);
+
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+
+    bool failed=file.write((const char *)&header,sizeof(header))!=(qint64)sizeof(header);
+
+    if(!failed && clusterCount)
+        failed=file.write((const char *)&clusters[0],clusterCount*sizeof(ClusterResultRecord))!=(qint64)(clusterCount*sizeof(ClusterResultRecord));
+
+    if(!failed)
+        failed=file.write((const char *)&lines[0],lines.size()*sizeof(int))!=(qint64)(lines.size()*sizeof(int));
+
+    //the point block goes out one line at a time, nothing is gathered first
+    for(int c=0;c<clusterCount && !failed;++c)
+        for(size_t e=0;e<result.clusterlist[c].size() && !failed;++e)
+        {
+            const std::vector<GGL::Point3f> &samples=result.clusterlist[c][e].samples;
+
+            if(!samples.empty())
+                failed=file.write((const char *)&samples[0],samples.size()*sizeof(GGL::Point3f))!=(qint64)(samples.size()*sizeof(GGL::Point3f));
+        }
+
+    file.close();
+
+    if(failed)
+        QFile::remove(filename);
+
+    return !failed;
+}
+
+bool readClusterResultFile(const QString &filename,ClusterResult &result,qint64 sourceBytes,qint64 sourceModified)
+{
+    QFile file(filename);
+
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    qint64 fileBytes=file.size();
+    uchar *mapped=NULL;
+
+    if(fileBytes<(qint64)sizeof(ClusterResultHeader) || !(mapped=file.map(0,fileBytes)))
+        return false;
+
+    ClusterResultHeader header;
+    memcpy(&header,mapped,sizeof(header));
+
+    //a file from a machine of the other byte order would need converting, it is refused instead
+    bool valid=memcmp(header.magic,"CRF1",4)==0 && header.version==clusterResultVersion
+            && header.byteOrder==clusterResultByteOrder
+            && (sourceBytes==0 || (header.sourceBytes==sourceBytes && header.sourceModified==sourceModified))
+            && header.clusterCount>=0 && header.lineCount>=0 && header.pointCount>=0
+            && header.clusterOffset==(qint64)sizeof(header)
+            && header.lineOffset==header.clusterOffset+(qint64)header.clusterCount*(qint64)sizeof(ClusterResultRecord)
+            && header.pointOffset==header.lineOffset+(qint64)(header.lineCount+1)*(qint64)sizeof(int)
+            && header.pointOffset+header.pointCount*(qint64)sizeof(GGL::Point3f)==fileBytes;
+
+    const ClusterResultRecord *clusters=(const ClusterResultRecord *)(mapped+header.clusterOffset);
+    const int *lines=(const int *)(mapped+header.lineOffset);
+    const GGL::Point3f *points=(const GGL::Point3f *)(mapped+header.pointOffset);
+
+    //the tables are checked whole before anything is built, applyResult indexes by the entropy lines
+    //of a cluster that has lines
+    for(int c=0;c<header.clusterCount && valid;++c)
+        valid=clusters[c].lineCount>=0 && clusters[c].firstLine>=0
+                && clusters[c].firstLine<=header.lineCount-clusters[c].lineCount
+                && (clusters[c].lineCount==0
+                    || (clusters[c].largestEntropy>=0 && clusters[c].largestEntropy<clusters[c].lineCount
+                        && clusters[c].smallestEntropy>=0 && clusters[c].smallestEntropy<clusters[c].lineCount));
+
+    for(int i=0;i<header.lineCount && valid;++i)
+        valid=lines[i]>=0 && lines[i]<=lines[i+1];
+
+    valid=valid && lines[0]==0 && lines[header.lineCount]==header.pointCount;
+
+    if(valid)
+    {
+        ClusterResult loaded;
+
+        loaded.clusterlist.resize(header.clusterCount);
+        loaded.largestEntropy.resize(header.clusterCount);
+        loaded.smallestEntropy.resize(header.clusterCount);
+        loaded.variations.resize(header.clusterCount);
+
+        for(int c=0;c<header.clusterCount;++c)
+        {
+            const ClusterResultRecord &record=clusters[c];
+            std::vector<StreamSampleLine> &aCluster=loaded.clusterlist[c];
+
+            aCluster.resize(record.lineCount);
+
+            for(int e=0;e<record.lineCount;++e)
+            {
+                int line=record.firstLine+e;
+                aCluster[e].samples.assign(points+lines[line],points+lines[line+1]);
+            }
+
+            loaded.largestEntropy[c]=record.largestEntropy;
+            loaded.smallestEntropy[c]=record.smallestEntropy;
+            loaded.variations[c]=record.variation;
+        }
+
+        result.clusterlist.swap(loaded.clusterlist);
+        result.largestEntropy.swap(loaded.largestEntropy);
+        result.smallestEntropy.swap(loaded.smallestEntropy);
+        result.variations.swap(loaded.variations);
+    }
+
+    file.unmap(mapped);
+    file.close();
+
+    return valid;
+}
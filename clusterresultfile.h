@@ -0,0 +1,72 @@
+#ifndef CLUSTERRESULTFILE_H
+#define CLUSTERRESULTFILE_H
+
+#include <vector>
+#include <QtCore/QtGlobal>
+#include <QtCore/QString>
+#include "Point3.h"
+
+struct StreamSampleLine
+{
+    std::vector<GGL::Point3f> samples;
+   // std::vector<float> curvatures;
+};
+
+//the contents of a cluster result file, parsed apart from DrawIllustrativeData so it can be read on any thread
+struct ClusterResult
+{
+    std::vector< std::vector<StreamSampleLine> > clusterlist;
+    std::vector<int> largestEntropy;
+    std::vector<int> smallestEntropy;
+    std::vector<float> variations;
+};
+
+//Header of a .crf cluster result, the binary form of a cluster-*.dat file. The cluster table,
+//the line table and the points follow it, offsets are from the start of the file. Lines of a
+//cluster are consecutive and the points of all lines are one block of float triples.
+struct ClusterResultHeader
+{
+    char magic[4];
+    int version;
+    int byteOrder;
+
+    int clusterCount;
+    int lineCount;
+    int reserved;
+    qint64 pointCount;
+
+    //size and modification time of the .dat file this was converted from, 0 when it was written directly
+    qint64 sourceBytes;
+    qint64 sourceModified;
+
+    //clusterCount ClusterResultRecord
+    qint64 clusterOffset;
+    //lineCount+1 ints, the first point of every line and the end of the last
+    qint64 lineOffset;
+    qint64 pointOffset;
+};
+
+struct ClusterResultRecord
+{
+    int firstLine;
+    int lineCount;
+
+    //indices into the lines of the cluster
+    int largestEntropy;
+    int smallestEntropy;
+
+    float variation;
+    int reserved;
+};
+
+enum {clusterResultVersion=2, clusterResultByteOrder=0x01020304};
+
+//clusters without lines are kept, a .dat may have them
+bool writeClusterResultFile(const QString &filename,const ClusterResult &result,qint64 sourceBytes=0,qint64 sourceModified=0);
+
+//Maps the file and copies each line out in one piece. False when it is not a .crf this build can
+//read, its tables do not fit the file or, with sourceBytes given, it was converted from another
+//file or from an older version of this one.
+bool readClusterResultFile(const QString &filename,ClusterResult &result,qint64 sourceBytes=0,qint64 sourceModified=0);
+
+#endif // CLUSTERRESULTFILE_H
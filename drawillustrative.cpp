@@ -1,6 +1,12 @@
 #include "drawillustrative.h"
 #include "VectorField.h"
 #include "drawillustrativedata.h"
+#include "fieldloader.h"
+#include "GlobalProgressBar.h"
+#include "streamlineclustering.h"
+#include <QtCore/QtConcurrentRun>
+#include <QtGui/QFileDialog>
+#include <QtGui/QMessageBox>
 //#include <sys/time.h>
 #include <QString>
 
@@ -218,6 +224,28 @@ DrawIllustrative::DrawIllustrative(QString name,QWidget *parent):DockWidget(name
         gridLayout->addWidget(smoothLabel,5,4,1,1);
         gridLayout->addWidget(smoothness,5,5,1,1);
 
+        clusterLineCountLabel=new QLabel(this);
+        clusterLineCountLabel->setText("Traced Lines");
+
+        clusterLineCount=new QSpinBox(this);
+        clusterLineCount->setMinimum(100);
+        clusterLineCount->setMaximum(5000);
+        clusterLineCount->setSingleStep(100);
+        clusterLineCount->setValue(1000);
+
+        clusterCountLabel=new QLabel(this);
+        clusterCountLabel->setText("Clusters");
+
+        clusterCount=new QSpinBox(this);
+        clusterCount->setMinimum(1);
+        clusterCount->setMaximum(64);
+        clusterCount->setValue(16);
+
+        gridLayout->addWidget(clusterLineCountLabel,6,0,1,1);
+        gridLayout->addWidget(clusterLineCount,6,1,1,1);
+        gridLayout->addWidget(clusterCountLabel,6,2,1,1);
+        gridLayout->addWidget(clusterCount,6,3,1,1);
+
         verticalLayout->addWidget(manualInsertGroupBox);
         tapeWidthBase->setValue(0.6);
 tapeWidthFlex->setValue(1.9);
@@ -231,6 +259,11 @@ tapeWidthFlex->setValue(1.9);
 
         horizontalLayout->addWidget(loadPushButton);
 
+        clusterPushButton = new QPushButton(automaticGroupBox);
+        clusterPushButton->setObjectName(QString::fromUtf8("clusterPushButton"));
+
+        horizontalLayout->addWidget(clusterPushButton);
+
         generatePushButton = new QPushButton(automaticGroupBox);
         generatePushButton->setObjectName(QString::fromUtf8("generatePushButton"));
 
@@ -241,6 +274,16 @@ tapeWidthFlex->setValue(1.9);
 
         horizontalLayout->addWidget(testPushButton);
 
+        saveTapesPushButton = new QPushButton(automaticGroupBox);
+        saveTapesPushButton->setObjectName(QString::fromUtf8("saveTapesPushButton"));
+
+        horizontalLayout->addWidget(saveTapesPushButton);
+
+        loadTapesPushButton = new QPushButton(automaticGroupBox);
+        loadTapesPushButton->setObjectName(QString::fromUtf8("loadTapesPushButton"));
+
+        horizontalLayout->addWidget(loadTapesPushButton);
+
 
         verticalLayout->addWidget(automaticGroupBox);
 
@@ -263,14 +306,30 @@ tapeWidthFlex->setValue(1.9);
  //       addALinePushButton->setText(QApplication::translate("DrawIllustrative", "Add", 0, QApplication::UnicodeUTF8));
         automaticGroupBox->setTitle(QApplication::translate("DrawIllustrative", "Auto:", 0, QApplication::UnicodeUTF8));
         loadPushButton->setText(QApplication::translate("DrawIllustrative", "Load", 0, QApplication::UnicodeUTF8));
+        clusterPushButton->setText(QApplication::translate("DrawIllustrative","Trace && Cluster",0,QApplication::UnicodeUTF8));
         generatePushButton->setText(QApplication::translate("DrawIllustrative", "PushButton", 0, QApplication::UnicodeUTF8));
         testPushButton->setText(QApplication::translate("DrawIllustrative","Test",0,QApplication::UnicodeUTF8));
+        saveTapesPushButton->setText(QApplication::translate("DrawIllustrative","Save Tapes",0,QApplication::UnicodeUTF8));
+        loadTapesPushButton->setText(QApplication::translate("DrawIllustrative","Load Tapes",0,QApplication::UnicodeUTF8));
 
         connect(&VectorField::getSingleton(),SIGNAL(dataUpdated()),this,SLOT(onDataUpdated()));
       //  connect(addALinePushButton,SIGNAL(clicked()),this,SLOT(onAddATape()));
       //  connect(thresholdDoubleSpinBox,SIGNAL(valueChanged(double)),this,SLOT(thresholdValueChanged(double)));
         connect(loadPushButton,SIGNAL(clicked()),this,SLOT(onLoadData()));
+        connect(clusterPushButton,SIGNAL(clicked()),this,SLOT(onTraceAndCluster()));
         connect(testPushButton,SIGNAL(clicked()),this,SLOT(onTest()));
+        connect(saveTapesPushButton,SIGNAL(clicked()),this,SLOT(onSaveTapes()));
+        connect(loadTapesPushButton,SIGNAL(clicked()),this,SLOT(onLoadTapes()));
+
+        fieldLoader=new FieldLoader(this);
+        resultWatcher=new QFutureWatcher<ClusterResult>(this);
+        fieldLoaded=false;
+        resultRead=false;
+        clusterPending=false;
+
+        connect(fieldLoader,SIGNAL(loaded()),this,SLOT(onFieldLoaded()));
+        connect(fieldLoader,SIGNAL(progress(int)),this,SLOT(onLoadProgress(int)));
+        connect(resultWatcher,SIGNAL(finished()),this,SLOT(onResultRead()));
 };
 
 void DrawIllustrative::onTest()
@@ -293,6 +352,31 @@ DrawIllustrativeData::getSingleton().setSmoothness(smoothness->value());
 
 }
 
+void DrawIllustrative::onSaveTapes()
+{
+    QString fileName = QFileDialog::getSaveFileName(this,tr("Save Tapes"), "./", tr("Streamline File (*.slf)"));
+
+    if (fileName.length()>0 && !DrawIllustrativeData::getSingleton().saveTapes(fileName))
+    {
+        QMessageBox msgBox;
+        msgBox.setText(QString("Cannot write %1").arg(fileName));
+        msgBox.exec();
+    }
+}
+
+void DrawIllustrative::onLoadTapes()
+{
+    //the tapes are drawn as they were saved, no field or cluster result is needed
+    QString fileName = QFileDialog::getOpenFileName(this,tr("Load Tapes"), "./", tr("Streamline File (*.slf)"));
+
+    if (fileName.length()>0 && !DrawIllustrativeData::getSingleton().loadTapes(fileName))
+    {
+        QMessageBox msgBox;
+        msgBox.setText(QString("Cannot read %1").arg(fileName));
+        msgBox.exec();
+    }
+}
+
 void DrawIllustrative::onRowChanged(int id)
 {
     currentSelected=id;
@@ -323,8 +407,81 @@ DrawIllustrativeData::getSingleton().setSmoothness(smoothness->value());
         DrawIllustrativeData::getSingleton().setDrawLargestEntropy(isDrawLargestEntropy->isChecked());
         DrawIllustrativeData::getSingleton().setDrawSmallestEntropy(isDrawSmallestEntropy->isChecked());
 
-        VectorField::getSingleton().init(resultfiles[currentSelected*5+1].toStdString().c_str(),resultfiles[currentSelected*5+2].toInt(),resultfiles[currentSelected*5+3].toInt(),resultfiles[currentSelected*5+4].toInt(),resultfiles[currentSelected*5]);
-        DrawIllustrativeData::getSingleton().loadResultFromFile(resultfiles[currentSelected*5]);
+        fieldLoaded=false;
+        resultRead=false;
+        clusterPending=false;
+
+        //setFuture below drops an earlier parse or clustering job, its result is never applied
+
+        fieldLoader->load(resultfiles[currentSelected*5+1],resultfiles[currentSelected*5+2].toInt(),resultfiles[currentSelected*5+3].toInt(),resultfiles[currentSelected*5+4].toInt(),resultfiles[currentSelected*5]);
+        resultWatcher->setFuture(QtConcurrent::run(&DrawIllustrativeData::readResultFromFile,resultfiles[currentSelected*5]));
+}
+
+void DrawIllustrative::onTraceAndCluster()
+{
+    //the field of the selected entry is loaded and clustered in the app, its .dat file is not read
+    DrawIllustrativeData::getSingleton().clear();
+    DrawIllustrativeData::getSingleton().setLineWidthBaseAndFlex(tapeWidthBase->value(),tapeWidthFlex->value());
+    DrawIllustrativeData::getSingleton().setSmoothness(smoothness->value());
+    DrawIllustrativeData::getSingleton().setDrawCenter(isDrawCenterCheckBox->isChecked());
+    DrawIllustrativeData::getSingleton().setDrawLargestEntropy(isDrawLargestEntropy->isChecked());
+    DrawIllustrativeData::getSingleton().setDrawSmallestEntropy(isDrawSmallestEntropy->isChecked());
+
+    fieldLoaded=false;
+    resultRead=false;
+
+    //the lines can only be traced once the field is in, onFieldLoaded starts the clustering. An
+    //earlier job still running is ignored by onResultRead until then and dropped by setFuture.
+    clusterPending=true;
+
+    fieldLoader->load(resultfiles[currentSelected*5+1],resultfiles[currentSelected*5+2].toInt(),resultfiles[currentSelected*5+3].toInt(),resultfiles[currentSelected*5+4].toInt(),resultfiles[currentSelected*5]);
+}
+
+void DrawIllustrative::onFieldLoaded()
+{
+    fieldLoaded=true;
+
+    if(clusterPending)
+    {
+        clusterPending=false;
+
+        //a load finishing during the tracing is held back until it ends, see VectorField::beginBackgroundRead
+        VectorField::getSingleton().beginBackgroundRead();
+        resultWatcher->setFuture(QtConcurrent::run(&StreamlineClustering::traceAndCluster,clusterLineCount->value(),clusterCount->value()));
+        return;
+    }
+
+    applyLoadedResult();
+}
+
+void DrawIllustrative::onResultRead()
+{
+    //the job of an earlier click, the clustering asked for since has not started yet
+    if(clusterPending)
+        return;
+
+    resultRead=true;
+    applyLoadedResult();
+}
+
+void DrawIllustrative::onLoadProgress(int percent)
+{
+    if(globalProgressBar)
+        globalProgressBar->setValue(percent);
+}
+
+void DrawIllustrative::applyLoadedResult()
+{
+    if(!fieldLoaded || !resultRead)
+        return;
+
+    fieldLoaded=resultRead=false;
+
+    ClusterResult result=resultWatcher->result();
+    DrawIllustrativeData::getSingleton().applyResult(result);
+
+    if(globalProgressBar)
+        globalProgressBar->setValue(0);
 }
 
 
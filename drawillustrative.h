@@ -24,6 +24,10 @@
 #include <QtGui/QCheckBox>
 #include <QtGui/QListWidget>
 #include <QtGui/QListWidgetItem>
+#include <QtCore/QFutureWatcher>
+
+class FieldLoader;
+struct ClusterResult;
 
 class DrawIllustrative:public DockWidget
 {
@@ -52,9 +56,12 @@ private:
      QGroupBox *automaticGroupBox;
      QHBoxLayout *horizontalLayout;
      QPushButton *loadPushButton;
+     QPushButton *clusterPushButton;
      QPushButton *generatePushButton;
      QSpacerItem *verticalSpacer;
      QPushButton *testPushButton;
+     QPushButton *saveTapesPushButton;
+     QPushButton *loadTapesPushButton;
      QCheckBox *isDrawCenterCheckBox;
      QCheckBox *isDrawLargestEntropy;
      QCheckBox *isDrawSmallestEntropy;
@@ -71,6 +78,21 @@ private:
     QLabel *smoothLabel;
     QSpinBox *smoothness;
 
+    QLabel *clusterLineCountLabel;
+    QSpinBox *clusterLineCount;
+    QLabel *clusterCountLabel;
+    QSpinBox *clusterCount;
+
+    //the field and the cluster file load in the background, the tapes are built once both are in
+    FieldLoader *fieldLoader;
+    QFutureWatcher<ClusterResult> *resultWatcher;
+    bool fieldLoaded;
+    bool resultRead;
+    //Trace && Cluster waits for the field before it starts
+    bool clusterPending;
+
+    void applyLoadedResult();
+
 public:
     DrawIllustrative(QString name,QWidget *parent);
     ~DrawIllustrative();
@@ -80,8 +102,14 @@ protected slots:
     void onAddATape();
     void thresholdValueChanged(double);
     void onLoadData();
+    void onTraceAndCluster();
     void onTest();
+    void onSaveTapes();
+    void onLoadTapes();
     void onRowChanged(int);
+    void onFieldLoaded();
+    void onResultRead();
+    void onLoadProgress(int);
 };
 
 #endif // DRAWILLUSTRATIVE_H
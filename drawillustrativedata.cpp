@@ -1,11 +1,17 @@
 #include <GL/glew.h>
 #include "drawillustrativedata.h"
 #include "VectorField.h"
+#include "integrator.h"
 #include <QGLWidget>
 #include "matrix44.h"
 #include "Sample.h"
 #include "Box3.h"
 #include "clustercolorscheme.h"
+#include "streamlinefile.h"
+#include "streamlineresampler.h"
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QDateTime>
 
 extern void eigen_decomposition(double A[3][3], double V[3][3], double d[3]);
 
@@ -24,145 +30,20 @@ DrawIllustrativeData::DrawIllustrativeData():illustrativeShaderProgram(0),_thres
 
 GGL::Point3f DrawIllustrativeData::movePointInBackward(float x,float y,float z)
 {
-    //const float deltaT=0.025f;
-
-    GGL::Point3f pos(x,y,z);
-
-    GGL::Point3f dir=VectorField::getSingleton().getVector(x,y,z);
-
-    float deltaT=1.5f/(dir.length());
-
-    if (deltaT>2.0f) {
-            deltaT=1.5f;
-    }
-
-    deltaT=-deltaT;
-
-    GGL::Point3f dd(dir);
-
-    GGL::Point3f k1(dd*deltaT);
-
-    GGL::Point3f tempP=pos+(k1*0.5f);
-
-    dir=VectorField::getSingleton().getVector(tempP.X(),tempP.Y(),tempP.Z());
-
-    dd=(dir);
-
-    GGL::Point3f  k2=dd*deltaT;
-
-    tempP=pos+k2*0.5f;
-
-    dir=VectorField::getSingleton().getVector(tempP.X(),tempP.Y(),tempP.Z());
-
-
-    dd=(dir);
-
-    GGL::Point3f  k3=dd*deltaT;
-
-    tempP=pos+(k3*0.5f);
-
-    dir=VectorField::getSingleton().getVector(tempP.X(),tempP.Y(),tempP.Z());
-
-    dd=(dir);
-
-    GGL::Point3f  k4=dd*deltaT;
-
-    pos+=(k1+k2*2.0f+k3*3.0f+k4)*(1.0f/6.0f);
-
-    return pos;
+    FieldSampler sampler;
+    return rk4Step<BackwardIntegration>(GGL::Point3f(x,y,z),SpeedScaledStep(),sampler);
 }
 
 GGL::Point3f DrawIllustrativeData::movePoint(float x, float y, float z, float deltaT)
 {
-    //const float deltaT=0.025f;
-
-    GGL::Point3f pos(x,y,z);
-
-    GGL::Point3f dir=VectorField::getSingleton().getVector(x,y,z);
-
-
-
-    GGL::Point3f dd(dir);
-
-    GGL::Point3f k1(dd*deltaT);
-
-    GGL::Point3f tempP=pos+(k1*0.5f);
-
-    dir=VectorField::getSingleton().getVector(tempP.X(),tempP.Y(),tempP.Z());
-
-    dd=(dir);
-
-    GGL::Point3f  k2=dd*deltaT;
-
-    tempP=pos+k2*0.5f;
-
-    dir=VectorField::getSingleton().getVector(tempP.X(),tempP.Y(),tempP.Z());
-
-
-    dd=(dir);
-
-    GGL::Point3f  k3=dd*deltaT;
-
-    tempP=pos+(k3*0.5f);
-
-    dir=VectorField::getSingleton().getVector(tempP.X(),tempP.Y(),tempP.Z());
-
-    dd=(dir);
-
-    GGL::Point3f  k4=dd*deltaT;
-
-    pos+=(k1+k2*2.0f+k3*3.0f+k4)*(1.0f/6.0f);
-
-    return pos;
+    FieldSampler sampler;
+    return rk4Step<ForwardIntegration>(GGL::Point3f(x,y,z),FixedStep(deltaT),sampler);
 }
 
 GGL::Point3f DrawIllustrativeData::movePoint(float x,float y,float z)
 {
-
-        //const float deltaT=0.025f;
-
-        GGL::Point3f pos(x,y,z);
-
-        GGL::Point3f dir=VectorField::getSingleton().getVector(x,y,z);
-
-        float deltaT=1.5f/(dir.length());
-
-        if (deltaT>2.0f) {
-                deltaT=1.5f;
-        }
-
-        GGL::Point3f dd(dir);
-
-        GGL::Point3f k1(dd*deltaT);
-
-        GGL::Point3f tempP=pos+(k1*0.5f);
-
-        dir=VectorField::getSingleton().getVector(tempP.X(),tempP.Y(),tempP.Z());
-
-        dd=(dir);
-
-        GGL::Point3f  k2=dd*deltaT;
-
-        tempP=pos+k2*0.5f;
-
-        dir=VectorField::getSingleton().getVector(tempP.X(),tempP.Y(),tempP.Z());
-
-
-        dd=(dir);
-
-        GGL::Point3f  k3=dd*deltaT;
-
-        tempP=pos+(k3*0.5f);
-
-        dir=VectorField::getSingleton().getVector(tempP.X(),tempP.Y(),tempP.Z());
-
-        dd=(dir);
-
-        GGL::Point3f  k4=dd*deltaT;
-
-        pos+=(k1+k2*2.0f+k3*3.0f+k4)*(1.0f/6.0f);
-
-        return pos;
+    FieldSampler sampler;
+    return rk4Step<ForwardIntegration>(GGL::Point3f(x,y,z),SpeedScaledStep(),sampler);
 }
 
 void DrawIllustrativeData::drawSilhouette(const GGL::Point3f &eye)
@@ -1619,7 +1500,29 @@ void DrawIllustrativeData::getBestLineMatch(std::vector<GGL::Point3f> pointList,
 
  void DrawIllustrativeData::loadResultFromFile(const QString &filename)
  {
+     ClusterResult result=readResultFromFile(filename);
+
+     applyResult(result);
+ }
+
+ ClusterResult DrawIllustrativeData::readResultFromFile(const QString &filename)
+ {
+     ClusterResult result;
+
+     if(readClusterResultFile(filename,result))
+         return result;
+
+     //the converted file is kept next to the .dat, or in the temp directory when that is read only.
+     //It remembers the size and modification time of the text it came from, so an edited .dat is
+     //converted again.
+     QString converted=filename+".crf";
+     QString temporary=QDir::temp().filePath(QFileInfo(converted).fileName());
+     QFileInfo source(filename);
+     qint64 sourceBytes=source.size();
+     qint64 sourceModified=source.lastModified().toTime_t();
 
+     if(sourceBytes>0 && (readClusterResultFile(converted,result,sourceBytes,sourceModified) || readClusterResultFile(temporary,result,sourceBytes,sourceModified)))
+         return result;
 
      QFile data(filename);
      if (data.open(QFile::ReadOnly))
@@ -1647,8 +1550,6 @@ void DrawIllustrativeData::getBestLineMatch(std::vector<GGL::Point3f> pointList,
 
                 in >> pointCount;
 
-               // qDebug("pointcount %d\n",pointCount);
-
                 while(pointCount--)
                 {
                     float x=0;
@@ -1659,18 +1560,13 @@ void DrawIllustrativeData::getBestLineMatch(std::vector<GGL::Point3f> pointList,
                     in >> y;
                     in >> z;
 
-                    // x=0;
-
-
                     n.samples.push_back(GGL::Point3f(x,y,z));
                 }
 
                 aCluster.push_back(n);
              }
 
-
-
-             clusterlist.push_back(aCluster);
+             result.clusterlist.push_back(aCluster);
 
              int mr=0;
              in >> mr;
@@ -1678,18 +1574,28 @@ void DrawIllustrativeData::getBestLineMatch(std::vector<GGL::Point3f> pointList,
              int mk=0;
              in>>mk;
 
-         //    mostRepresentative.push_back(0);
-             largestEntropy.push_back(mk);
-             smallestEntropy.push_back(mr);
+             result.largestEntropy.push_back(mk);
+             result.smallestEntropy.push_back(mr);
 
              float k;
              in >> k;
 
-             printf("variation %f\n",k);
+             result.variations.push_back(k);
          }
+
+         if(!result.clusterlist.empty() && !writeClusterResultFile(converted,result,sourceBytes,sourceModified))
+             writeClusterResultFile(temporary,result,sourceBytes,sourceModified);
      }
 
-     printf("f");
+     return result;
+ }
+
+ void DrawIllustrativeData::applyResult(ClusterResult &result)
+ {
+     clusterlist.swap(result.clusterlist);
+     largestEntropy.swap(result.largestEntropy);
+     smallestEntropy.swap(result.smallestEntropy);
+     variations.swap(result.variations);
 
   /*   for(int e=0;e<clusterlist.size();++e)
 
@@ -1702,6 +1608,71 @@ void DrawIllustrativeData::getBestLineMatch(std::vector<GGL::Point3f> pointList,
      ClusterColorScheme::getSingleton().resize(clusterlist.size());
  }
 
+ bool DrawIllustrativeData::saveTapes(const QString &filename)
+ {
+     StreamlineWriter writer;
+
+     //points are kept exact, tapes are few and their normals are derived from them
+     if(!writer.open(filename,StreamlineFile::Float32,StreamlineFile::Curvature|StreamlineFile::Torsion|StreamlineFile::Normal))
+         return false;
+
+     for(size_t e=0;e<tapes.size();++e)
+     {
+         writer.writeLine(tapes[e].empty()?NULL:&tapes[e][0],(int)tapes[e].size());
+
+         if(e<tapeNormals.size() && !tapeNormals[e].empty())
+             writer.writeAttribute(StreamlineFile::Normal,&tapeNormals[e][0][0],(int)tapeNormals[e].size());
+
+         //one curvature and torsion per cross section, not per point
+         if(e<tapeCurvatures.size() && !tapeCurvatures[e].empty())
+             writer.writeAttribute(StreamlineFile::Curvature,&tapeCurvatures[e][0],(int)tapeCurvatures[e].size());
+
+         if(e<tapeTorsions.size() && !tapeTorsions[e].empty())
+             writer.writeAttribute(StreamlineFile::Torsion,&tapeTorsions[e][0],(int)tapeTorsions[e].size());
+     }
+
+     return writer.close();
+ }
+
+ bool DrawIllustrativeData::loadTapes(const QString &filename)
+ {
+     StreamlineReader reader;
+
+     if(!reader.open(filename))
+         return false;
+
+     std::vector< std::vector<GGL::Point3f> > points(reader.getLineCount());
+     std::vector< std::vector<GGL::Point3f> > normals(reader.getLineCount());
+     std::vector< std::vector<float> > curvatures(reader.getLineCount());
+     std::vector< std::vector<float> > torsions(reader.getLineCount());
+     std::vector<float> values;
+
+     for(int e=0;e<reader.getLineCount();++e)
+     {
+         if(!reader.readLine(e,points[e]))
+             return false;
+
+         values.clear();
+         reader.readAttribute(e,StreamlineFile::Normal,values);
+
+         for(size_t i=0;i+2<values.size();i+=3)
+             normals[e].push_back(GGL::Point3f(values[i],values[i+1],values[i+2]));
+
+         //draw() reads a normal for every point
+         normals[e].resize(points[e].size(),GGL::Point3f(0,0,0));
+
+         reader.readAttribute(e,StreamlineFile::Curvature,curvatures[e]);
+         reader.readAttribute(e,StreamlineFile::Torsion,torsions[e]);
+     }
+
+     tapes.swap(points);
+     tapeNormals.swap(normals);
+     tapeCurvatures.swap(curvatures);
+     tapeTorsions.swap(torsions);
+
+     return true;
+ }
+
  void DrawIllustrativeData::computeAverateTapeFromAverageStartPoint(const GGL::Point3f &start)
  {
 
@@ -1847,12 +1818,37 @@ generateATapeFromRepresentativeLine(i,e);
      std::vector<GGL::Point3f> atape;
      std::vector<GGL::Point3f> tnormals;
 
+     //a section per sample, lines of another length are brought to 49 samples first. A line with
+     //less than two points or no length cannot be, it is left out of the sections but stays in the
+     //cluster so the entropy indices still match.
+     StreamlineResampler resampler(StreamlineResampler::UniformCount,49);
+     std::vector<const StreamSampleLine *> lines;
+
+     for(std::vector<StreamSampleLine>::iterator iter=input.begin();iter!=input.end();++iter)
+     {
+         std::vector<GGL::Point3f> resampled;
+
+         if((*iter).samples.size()!=49 && resampler.resample((*iter).samples.empty()?NULL:&(*iter).samples[0],(int)(*iter).samples.size(),resampled))
+             (*iter).samples.swap(resampled);
+
+         if((*iter).samples.size()==49)
+             lines.push_back(&(*iter));
+     }
+
+     //nothing to build sections from, an empty tape keeps the tapes in step with the clusters
+     if(lines.empty())
+     {
+         tapes.push_back(atape);
+         tapeNormals.push_back(tnormals);
+         return;
+     }
+
     for(int count=0;count<49;++count)
     {
           std::vector<GGL::Point3f> samples;
-        for(std::vector<StreamSampleLine>::iterator iter=input.begin();iter!=input.end();++iter)
+        for(size_t i=0;i<lines.size();++i)
         {
-            samples.push_back((*iter).samples[count]);
+            samples.push_back(lines[i]->samples[count]);
         }
 
 
@@ -2126,15 +2122,10 @@ void DrawIllustrativeData::generateATapeFromAStartPoint(const GGL::Point3f &star
   {
       std::vector<GGL::Point3f> presavedPointList;
 
-      GGL::Point3f currentPoint=startPoint;
-
-      presavedPointList.push_back(currentPoint);
+      CellSampler sampler;
+      NeverTerminate fullLength;
 
-      for(int i=0;i<150;++i)
-      {
-          currentPoint=movePoint(currentPoint.X(),currentPoint.Y(),currentPoint.Z());
-          presavedPointList.push_back(currentPoint);
-      }
+      rk4Trace<ForwardIntegration>(startPoint,150,SpeedScaledStep(),sampler,fullLength,presavedPointList);
 
       std::vector<GGL::Point3f> atape;
       std::vector<GGL::Point3f> tnormals;
@@ -2184,6 +2175,9 @@ void DrawIllustrativeData::generateATapeFromAStartPoint(const GGL::Point3f &star
       if(largestTorsion==0.0)
           largestTorsion=1.0f;
 
+      if(largestCurvature==0.0f)
+          largestCurvature=1.0f;
+
       for(int i=0;i<torsions.size();++i)
       {
           torsions[i]=1.0-torsions[i]/largestTorsion;
@@ -2345,122 +2339,57 @@ void DrawIllustrativeData::generateATapeFromAStartPoint(const GGL::Point3f &star
       tapeNormals.push_back(tnormals);
   }
 
-float DrawIllustrativeData::computeCurvature(GGL::Point3f &currentPos)
+//derivative of the velocity along its own streamline, d/dt v(p(t)) = J v
+static GGL::Point3f applyJacobian(const float jacobian[3][3],const GGL::Point3f &v)
 {
-    GGL::Point3f tangent;
-
-   float d = (tangent=VectorField::getSingleton().getVector(currentPos.X(),currentPos.Y(),currentPos.Z())).length();
-
-   GGL::Point3f nextSample=movePoint(currentPos.X(),currentPos.Y(),currentPos.Z(),0.001);
-
-   GGL::Point3f derivitive=VectorField::getSingleton().getVector(nextSample.X(),nextSample.Y(),nextSample.Z())-VectorField::getSingleton().getVector(currentPos.X(),currentPos.Y(),currentPos.Z());
-
-   derivitive/=0.001;
-
-   GGL::Point3f nextSampleNext=movePoint(nextSample.X(),nextSample.Y(),nextSample.Z(),0.001);
-
-   GGL::Point3f sampleDerivitive=VectorField::getSingleton().getVector(nextSampleNext.X(),nextSampleNext.Y(),nextSampleNext.Z())-VectorField::getSingleton().getVector(nextSample.X(),nextSample.Y(),nextSample.Z());
-
-   GGL::Point3f derivitive2=sampleDerivitive-derivitive;
-
-   derivitive2/=0.001;
-
-   d = tangent.length();
-
-
-
-   float u  = tangent.X();
-   float v  = tangent.Y();
-   float w  =tangent.Z();
-
-  float dxx  = derivitive.X();
-  float dyy  = derivitive.Y();
-  float dzz  = derivitive.Z();
-
-  float cxx = -w * dyy + v * dzz;
-  float cyy =  w * dxx - u * dzz;
-  float czz = -v * dxx + u * dyy;
-
- float  k = sqrt(cxx * cxx + cyy * cyy + czz * czz) / (d * d * d);
-
-   k = fabs(k);
-
-
-   GGL::Point3f a1=(nextSampleNext-nextSample).Normalize();
-   GGL::Point3f a2=(currentPos-nextSample).Normalize();
+    return GGL::Point3f(jacobian[0][0]*v.X()+jacobian[0][1]*v.Y()+jacobian[0][2]*v.Z(),
+                        jacobian[1][0]*v.X()+jacobian[1][1]*v.Y()+jacobian[1][2]*v.Z(),
+                        jacobian[2][0]*v.X()+jacobian[2][1]*v.Y()+jacobian[2][2]*v.Z());
+}
 
-    a1.Normalize();
-    a2.Normalize();
+float DrawIllustrativeData::computeCurvature(GGL::Point3f &currentPos)
+{
+    float jacobian[3][3];
 
-   k=(a1*a2);
+    GGL::Point3f tangent=VectorField::getSingleton().getVectorAndJacobian(currentPos.X(),currentPos.Y(),currentPos.Z(),jacobian);
 
-   k=fabs(k);
+    GGL::Point3f derivitive=applyJacobian(jacobian,tangent);
 
-  // float c=(tangent.length()-VectorField::getSingleton().minMag)/(VectorField::getSingleton().maxMag);
+    float d=tangent.length();
 
-   qDebug()<<"curv"<<k;
+    if(d==0)
+        return 0;
 
-  // return c;
+    //k = |v x v'| / |v|^3
+    float k=(tangent^derivitive).length()/(d*d*d);
 
-   return k;
+    return k;
 }
 
 float DrawIllustrativeData :: computeTorsion(GGL::Point3f &currentPos)
 {
+    float jacobian[3][3];
 
-    GGL::Point3f tangent;
-
-   float d = (tangent=VectorField::getSingleton().getVector(currentPos.X(),currentPos.Y(),currentPos.Z())).length();
-
-   GGL::Point3f nextSample=movePoint(currentPos.X(),currentPos.Y(),currentPos.Z(),0.001);
+    GGL::Point3f tangent=VectorField::getSingleton().getVectorAndJacobian(currentPos.X(),currentPos.Y(),currentPos.Z(),jacobian);
 
-   GGL::Point3f derivitive=VectorField::getSingleton().getVector(nextSample.X(),nextSample.Y(),nextSample.Z())-VectorField::getSingleton().getVector(currentPos.X(),currentPos.Y(),currentPos.Z());
+    GGL::Point3f derivitive=applyJacobian(jacobian,tangent);
 
-   derivitive/=0.001;
+    //J (J v), the (grad J) v v term is deliberately left out as an approximation, J does vary
+    //inside a trilinear cell
+    GGL::Point3f derivitive2=applyJacobian(jacobian,derivitive);
 
-   GGL::Point3f nextSampleNext=movePoint(nextSample.X(),nextSample.Y(),nextSample.Z(),0.001);
+    GGL::Point3f c=tangent^derivitive;
 
-   GGL::Point3f sampleDerivitive=VectorField::getSingleton().getVector(nextSampleNext.X(),nextSampleNext.Y(),nextSampleNext.Z())-VectorField::getSingleton().getVector(nextSample.X(),nextSample.Y(),nextSample.Z());
-
-   GGL::Point3f derivitive2=sampleDerivitive-derivitive;
-
-   derivitive2/=0.001;
-
-    float u0  = tangent.X();
-   float v0  = tangent.Y();
-  float  w0  = tangent.Z();
-
-   float u1  = derivitive.X();
- float   v1  = derivitive.Y();
-   float w1  = derivitive.Z();
-
-  float  u2  = derivitive2.X();
-   float v2  = derivitive2.Y();
-   float w2  = derivitive2.Z();
-
-/*  float  h  = u0 * (v1 * w2 - v2 * w1)
-        -u1 * (v0 * w2 - v2 * w0)
-        +u2 * (v0 * w1 - v1 * w0);
-
- float   cxx = -w0 * v1 + v0 * w1;
-  float  cyy =  w0 * u1 - u0 * w1;
-   float czz = -v0 * u1 + u0 * v1;
-
-  float  q = cxx * cxx + cyy * cyy + czz * czz;
-*/
-
-
-   float h=w2*(u0*v1-v0*u1)+w1*(u2*v0-u0*v2)+w0*(u1*v2+u2*v1);
-
-   float q=(u0*u0+v0*v0+w0*w0)*(u1*u1+v1*v1+w1*w1);
+    //t = (v x v') . v'' / |v x v'|^2
+    float h=c*derivitive2;
 
+    float q=c*c;
 
     if (q == 0) {
         return 0;
-        //continue;
     }
 
- float   t = h / q;
+    float t = h / q;
 
     t = fabs(t);
     return t;
@@ -2468,12 +2397,11 @@ float DrawIllustrativeData :: computeTorsion(GGL::Point3f &currentPos)
 
 GGL::Point3f  DrawIllustrativeData::    computeBiNormalDirection(GGL::Point3f &currentPos)
 {
-    GGL::Point3f tangenta=VectorField::getSingleton().getVector(currentPos.X(),currentPos.Y(),currentPos.Z());
-    GGL::Point3f nextPos=movePoint(currentPos.X(),currentPos.Y(),currentPos.Z(),0.001);
+    float jacobian[3][3];
 
-    GGL::Point3f tangentb=VectorField::getSingleton().getVector(nextPos.X(),nextPos.Y(),nextPos.Z());
+    GGL::Point3f tangenta=VectorField::getSingleton().getVectorAndJacobian(currentPos.X(),currentPos.Y(),currentPos.Z(),jacobian);
 
-    GGL::Point3f normal=(tangentb-tangenta).Normalize();
+    GGL::Point3f normal=applyJacobian(jacobian,tangenta).Normalize();
 
     return (tangenta^normal).Normalize();
 }
@@ -2540,6 +2468,9 @@ GGL::Point3f  DrawIllustrativeData::    computeBiNormalDirection(GGL::Point3f &c
      if(largestTorsion==0.0)
          largestTorsion=1.0f;
 
+     if(largestCurvature==0.0f)
+         largestCurvature=1.0f;
+
      for(int i=0;i<torsions.size();++i)
      {
          torsions[i]=/*1.0-*/torsions[i]/largestTorsion;
@@ -2781,17 +2712,14 @@ for(int i=1;i<clusterlist[clusterid][rlid].samples.size()-1;++i)
  {
     std::vector<GGL::Point3f> presavedPointList;
 
-    GGL::Point3f currentPoint=startPoint;
+    CellSampler sampler;
+    NeverTerminate fullLength;
 
-    presavedPointList.push_back(currentPoint);
+    rk4Trace<ForwardIntegration>(startPoint,150,SpeedScaledStep(),sampler,fullLength,presavedPointList);
 
-    for(int i=0;i<150;++i)
-    {
-        currentPoint=movePoint(currentPoint.X(),currentPoint.Y(),currentPoint.Z());
-        presavedPointList.push_back(currentPoint);
-    }
+    GGL::Point3f currentPoint=presavedPointList.back();
 
-    GGL::Point3f dir=VectorField::getSingleton().getVector(currentPoint.X(),currentPoint.Y(),currentPoint.Z());
+    GGL::Point3f dir=sampler(currentPoint);
 
     GGL::Point3f viewDir=eye-currentPoint;
 
@@ -2801,13 +2729,7 @@ for(int i=1;i<clusterlist[clusterid][rlid].samples.size()-1;++i)
 
     currentPoint=currentPoint+tapeDir;
 
-    presavedTape.push_back(currentPoint);
-
-    for(int i=0;i<150;++i)
-    {
-        currentPoint=movePointInBackward(currentPoint.X(),currentPoint.Y(),currentPoint.Z());
-        presavedTape.push_back(currentPoint);
-    }
+    rk4Trace<BackwardIntegration>(currentPoint,150,SpeedScaledStep(),sampler,fullLength,presavedTape);
 
     std::vector<GGL::Point3f> atape;
     std::vector<GGL::Point3f> tnormals;
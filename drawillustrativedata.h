@@ -6,13 +6,7 @@
 #include <QGLShaderProgram>
 #include <QtOpenGL>
 #include "matrix44.h"
-
-
-struct StreamSampleLine
-{
-    std::vector<GGL::Point3f> samples;
-   // std::vector<float> curvatures;
-};
+#include "clusterresultfile.h"
 
 struct BestLine
 {
@@ -211,6 +205,16 @@ public:
 
     void loadResultFromFile(const QString &filename);
 
+    //a .crf file is mapped, a text .dat file is parsed once and converted to a .crf next to it
+    static ClusterResult readResultFromFile(const QString &filename);
+
+    //takes over a parsed result and builds its tapes, the matching field has to be loaded
+    void applyResult(ClusterResult &result);
+
+    //the tapes with their normals, curvatures and torsions as a .slf streamline file
+    bool saveTapes(const QString &filename);
+    bool loadTapes(const QString &filename);
+
     void computeSections(std::vector<StreamSampleLine>&);
 
     void computeAverageTape();
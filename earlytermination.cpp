@@ -0,0 +1,336 @@
+#include "earlytermination.h"
+#include "VectorField.h"
+
+static float determinant(const float m[3][3])
+{
+    return m[0][0]*(m[1][1]*m[2][2]-m[1][2]*m[2][1])
+          -m[0][1]*(m[1][0]*m[2][2]-m[1][2]*m[2][0])
+          +m[0][2]*(m[1][0]*m[2][1]-m[1][1]*m[2][0]);
+}
+
+EarlyTermination::EarlyTermination(const std::vector<GGL::Point3f> &_points,float _sign,int _maxSteps,float _tolerance)
+    :points(_points),field(VectorField::getSingleton()),sign(_sign),maxSteps(_maxSteps),tolerance(_tolerance),usedSlots(0),stamp(0)
+{
+    xBlocks=((field.xSize-2)>>cellBits)+1;
+    yBlocks=((field.ySize-2)>>cellBits)+1;
+
+    Slot empty={-1,-1,-1};
+    cellSlots.assign(64,empty);
+
+    restart();
+}
+
+void EarlyTermination::restart()
+{
+    //slots from earlier lines carry an older stamp and count as empty
+    ++stamp;
+    usedSlots=0;
+    runs.clear();
+
+    first=(int)points.size();
+    steps=0;
+    shrinking=0;
+    previous=0.0f;
+    currentCell=-2;
+    currentRun=-1;
+    reason=Running;
+}
+
+int EarlyTermination::cellOf(const GGL::Point3f &p) const
+{
+    float x=p.X();
+    float y=p.Y();
+    float z=p.Z();
+
+    //written so that a NaN from a diverged Newton step is outside as well
+    if(!(x>=0.0f && x<=(float)(field.xSize-1) && y>=0.0f && y<=(float)(field.ySize-1) && z>=0.0f && z<=(float)(field.zSize-1)))
+        return -1;
+
+    int ix=qMin((int)x,field.xSize-2)>>cellBits;
+    int iy=qMin((int)y,field.ySize-2)>>cellBits;
+    int iz=qMin((int)z,field.zSize-2)>>cellBits;
+
+    return ix+iy*xBlocks+iz*xBlocks*yBlocks;
+}
+
+int EarlyTermination::findSlot(int cell)
+{
+    //at most half full, so probing stays short
+    if(usedSlots*2>=(int)cellSlots.size())
+    {
+        std::vector<Slot> old;
+        old.swap(cellSlots);
+
+        Slot empty={-1,-1,-1};
+        cellSlots.assign(old.size()*2,empty);
+        usedSlots=0;
+
+        for(size_t i=0;i<old.size();++i)
+            if(old[i].stamp==stamp)
+                cellSlots[findSlot(old[i].cell)]=old[i];
+    }
+
+    unsigned int mask=(unsigned int)cellSlots.size()-1;
+    unsigned int i=((unsigned int)cell*2654435761u)&mask;
+
+    for(;;i=(i+1)&mask)
+    {
+        Slot &slot=cellSlots[i];
+
+        if(slot.stamp!=stamp)
+        {
+            slot.cell=cell;
+            slot.stamp=stamp;
+            slot.lastRun=-1;
+            ++usedSlots;
+
+            return (int)i;
+        }
+
+        if(slot.cell==cell)
+            return (int)i;
+    }
+}
+
+void EarlyTermination::enterCell(int cell,int slot,int index)
+{
+    currentCell=cell;
+    currentRun=-1;
+
+    if(cell<0)
+        return;
+
+    Run run={index,index,cellSlots[slot].lastRun};
+    runs.push_back(run);
+
+    currentRun=(int)runs.size()-1;
+    cellSlots[slot].lastRun=currentRun;
+}
+
+static float segmentDistance(const GGL::Point3f &p,const GGL::Point3f &a,const GGL::Point3f &b)
+{
+    GGL::Point3f segment=b-a;
+    float squared=segment*segment;
+    float t=squared>0.0f?qBound(0.0f,((p-a)*segment)/squared,1.0f):0.0f;
+
+    return (a+segment*t-p).length();
+}
+
+int EarlyTermination::retraces(const Run &run,const GGL::Point3f &from,const GGL::Point3f &to,float allowed) const
+{
+    GGL::Point3f step=to-from;
+    float length=step.length();
+
+    //the segments into and out of the block belong to the pass as well
+    int begin=qMax(first,run.begin-1);
+    int end=qMin((int)points.size()-1,run.end+1);
+
+    for(int i=begin;i<end;++i)
+    {
+        GGL::Point3f segment=points[i+1]-points[i];
+        float segmentLength=segment.length();
+
+        //the same way round, a line crossing its own path is not an orbit
+        if(segmentLength==0.0f || segment*step<0.9f*segmentLength*length)
+            continue;
+
+        if(segmentDistance(to,points[i],points[i+1])<allowed)
+            return i;
+    }
+
+    return -1;
+}
+
+bool EarlyTermination::repeats(int match,int index,float allowed) const
+{
+    //the last turn has to lie on the turn before it all the way round, a line on a torus or a
+    //slow spiral only passes close to an earlier turn here and there
+    int period=index-match;
+
+    if(match-period<first)
+        return false;
+
+    int begin=qMax(first,match-period-1);
+
+    for(int i=match+1;i<index;++i)
+    {
+        float nearest=allowed;
+
+        for(int j=begin;j<=match && nearest>=allowed;++j)
+            nearest=segmentDistance(points[i],points[j],points[j+1]);
+
+        if(nearest>=allowed)
+            return false;
+    }
+
+    return true;
+}
+
+bool EarlyTermination::cellHasZero(const GGL::Point3f &p) const
+{
+    int ix=qMin((int)p.X(),field.xSize-2);
+    int iy=qMin((int)p.Y(),field.ySize-2);
+    int iz=qMin((int)p.Z(),field.zSize-2);
+
+    float corners[24];
+    field.getCellCorners(0,ix,iy,iz,corners);
+
+    //a component that keeps its sign over all 8 corners cannot vanish inside the cell
+    for(int c=0;c<3;++c)
+    {
+        float low=corners[c];
+        float high=corners[c];
+
+        for(int k=1;k<8;++k)
+        {
+            low=qMin(low,corners[k*3+c]);
+            high=qMax(high,corners[k*3+c]);
+        }
+
+        if(low>0.0f || high<0.0f)
+            return false;
+    }
+
+    return true;
+}
+
+//solves jacobian*d=v by Cramer's rule, false when the jacobian is singular
+static bool solve(const float jacobian[3][3],const GGL::Point3f &v,GGL::Point3f &d)
+{
+    float det=determinant(jacobian);
+
+    if(det==0.0f)
+        return false;
+
+    for(int c=0;c<3;++c)
+    {
+        float m[3][3];
+
+        for(int i=0;i<3;++i)
+            for(int j=0;j<3;++j)
+                m[i][j]=j==c?v[i]:jacobian[i][j];
+
+        d[c]=determinant(m)/det;
+    }
+
+    return true;
+}
+
+bool EarlyTermination::nearSink(const GGL::Point3f &p,int cell) const
+{
+    //a few Newton steps to the zero of the trilinear field, it has to be in the same block
+    float jacobian[3][3];
+    GGL::Point3f zero=p;
+    GGL::Point3f v=field.getVectorAndJacobian(p.X(),p.Y(),p.Z(),jacobian);
+    float speed=v.length();
+    GGL::Point3f d;
+
+    for(int i=0;i<4;++i)
+    {
+        if(!solve(jacobian,v,d))
+            return false;
+
+        zero-=d;
+
+        if(cellOf(zero)!=cell || (zero-p).length()>=tolerance*0.5f)
+            return false;
+
+        v=field.getVectorAndJacobian(zero.X(),zero.Y(),zero.Z(),jacobian);
+    }
+
+    //a nearly singular jacobian sends Newton nowhere, only a true zero leaves no residual
+    if(v.length()>speed*0.001f)
+        return false;
+
+    //the line has to be closing in on it, the linearization alone does not hold that far out
+    float distance=(p-zero).length();
+
+    for(int i=(int)points.size()-1;i>=qMax(first,(int)points.size()-minApproach);--i)
+    {
+        float earlier=(points[i]-zero).length();
+
+        if(earlier<=distance)
+            return false;
+
+        distance=earlier;
+    }
+
+    //the flow as traced around the zero, a backward line runs into sources
+    float a[3][3];
+
+    for(int i=0;i<3;++i)
+        for(int j=0;j<3;++j)
+            a[i][j]=jacobian[i][j]*sign;
+
+    float trace=a[0][0]+a[1][1]+a[2][2];
+    float minors=a[0][0]*a[1][1]-a[0][1]*a[1][0]+a[0][0]*a[2][2]-a[0][2]*a[2][0]+a[1][1]*a[2][2]-a[1][2]*a[2][1];
+    float det=determinant(a);
+
+    //Routh-Hurwitz on l^3-trace*l^2+minors*l-det, every eigenvalue has a negative real part
+    return trace<0.0f && det<0.0f && -trace*minors>-det;
+}
+
+bool EarlyTermination::operator()(const GGL::Point3f &from,const GGL::Point3f &to)
+{
+    if(currentCell==-2)
+    {
+        int cell=cellOf(from);
+        enterCell(cell,cell>=0?findSlot(cell):-1,first);
+    }
+
+    ++steps;
+
+    float length=(to-from).length();
+
+    if(length<0.00001f)
+        return stop(Stalled);
+
+    //a line that keeps slowing down and would not get anywhere visible at its current pace over
+    //the rest of the budget
+    window[steps%windowSize]=length;
+    shrinking=length<previous?shrinking+1:0;
+    previous=length;
+
+    if(shrinking>=windowSize && window[(steps+1)%windowSize]*(maxSteps-steps+1)<tolerance)
+        return stop(Stagnated);
+
+    //the index to will get once the kernel appends it
+    int index=(int)points.size();
+    int cell=cellOf(to);
+
+    if(cell!=currentCell)
+    {
+        int slot=-1;
+
+        if(cell>=0)
+        {
+            slot=findSlot(cell);
+
+            //only the latest pass that is a whole turn back, older turns of an orbit lie on it
+            int r=cellSlots[slot].lastRun;
+
+            while(r>=0 && runs[r].end>=index-minLoopSteps)
+                r=runs[r].next;
+
+            if(r>=0)
+            {
+                //whatever the last turn is off by it drifts again on every turn left
+                float allowed=tolerance/(float)(2+2*(maxSteps-steps)/(index-runs[r].begin));
+                int match=retraces(runs[r],from,to,allowed);
+
+                if(match>=0 && repeats(match,index,allowed))
+                    return stop(ClosedOrbit);
+            }
+        }
+
+        enterCell(cell,slot,index);
+    }
+    else if(currentRun>=0)
+        runs[currentRun].end=index;
+
+    //closing in on an attracting zero, the line slows down all the way in
+    if(cell>=0 && shrinking>=minApproach && length<tolerance && cellHasZero(to) && nearSink(to,cell))
+        return stop(CriticalPoint);
+
+    return false;
+}
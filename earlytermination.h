@@ -0,0 +1,88 @@
+#ifndef EARLYTERMINATION_H
+#define EARLYTERMINATION_H
+
+#include <vector>
+#include "Point3.h"
+
+class VectorField;
+
+//Termination policy that ends a line as soon as the rest of it could not be seen: it stagnates,
+//it retraces an orbit it already drew, or it closes in on a sink. Visited blocks of cells go into
+//a small open addressing hash per line, each with the runs of points the line left in it, so a
+//loop is found by comparing the current step with the last earlier run through the same block.
+//Distances are in voxels, tolerance is the largest deviation treated as invisible.
+class EarlyTermination
+{
+public:
+    enum Reason {Running, Stalled, Stagnated, ClosedOrbit, CriticalPoint};
+
+private:
+    enum {cellBits=2, windowSize=16, minApproach=4, minLoopSteps=8};
+
+    struct Slot
+    {
+        int cell;
+        int stamp;
+        int lastRun;
+    };
+
+    //points begin..end of one pass through a block, the runs of a block are linked through next
+    struct Run
+    {
+        int begin;
+        int end;
+        int next;
+    };
+
+    const std::vector<GGL::Point3f> &points;
+    VectorField &field;
+    float sign;
+    int maxSteps;
+    float tolerance;
+    int xBlocks;
+    int yBlocks;
+
+    std::vector<Slot> cellSlots;
+    int usedSlots;
+    int stamp;
+    std::vector<Run> runs;
+
+    int first;
+    int steps;
+    int shrinking;
+    float previous;
+    int currentCell;
+    int currentRun;
+    float window[windowSize];
+    Reason reason;
+
+    int cellOf(const GGL::Point3f &p) const;
+    int findSlot(int cell);
+    void enterCell(int cell,int slot,int index);
+    int retraces(const Run &run,const GGL::Point3f &from,const GGL::Point3f &to,float allowed) const;
+    bool repeats(int match,int index,float allowed) const;
+    bool cellHasZero(const GGL::Point3f &p) const;
+    bool nearSink(const GGL::Point3f &p,int cell) const;
+
+    bool stop(Reason _reason)
+    {
+        reason=_reason;
+        return true;
+    };
+
+public:
+    //points is the buffer the line is appended to, sign is -1 for lines traced backward
+    EarlyTermination(const std::vector<GGL::Point3f> &_points,float _sign=1.0f,int _maxSteps=500,float _tolerance=0.05f);
+
+    //the next line starts at the next point appended to points, the hash is emptied in O(1)
+    void restart();
+
+    bool operator()(const GGL::Point3f &from,const GGL::Point3f &to);
+
+    Reason getReason() const
+    {
+        return reason;
+    };
+};
+
+#endif // EARLYTERMINATION_H
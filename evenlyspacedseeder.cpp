@@ -0,0 +1,192 @@
+#include "evenlyspacedseeder.h"
+#include "VectorField.h"
+#include "integrator.h"
+#include <stdlib.h>
+
+//steps per direction, the same budget as a random streamline
+static const int maxSteps=500;
+//random seeds tried for a region no accepted line reaches
+static const int restartAttempts=200;
+
+SeparationGrid::SeparationGrid(float xSize,float ySize,float zSize,float _cellSize):cellSize(_cellSize)
+{
+    xCells=qMax(1,(int)(xSize/cellSize)+1);
+    yCells=qMax(1,(int)(ySize/cellSize)+1);
+    zCells=qMax(1,(int)(zSize/cellSize)+1);
+
+    cells.resize(xCells*yCells*zCells);
+}
+
+void SeparationGrid::cellOf(const GGL::Point3f &p,int &x,int &y,int &z) const
+{
+    x=qBound(0,(int)(p.X()/cellSize),xCells-1);
+    y=qBound(0,(int)(p.Y()/cellSize),yCells-1);
+    z=qBound(0,(int)(p.Z()/cellSize),zCells-1);
+}
+
+void SeparationGrid::insert(const std::vector<GGL::Point3f> &points)
+{
+    int x,y,z;
+
+    for(size_t i=0;i<points.size();++i)
+    {
+        cellOf(points[i],x,y,z);
+        cells[x+y*xCells+z*xCells*yCells].push_back(points[i]);
+    }
+}
+
+bool SeparationGrid::isFree(const GGL::Point3f &p,float distance) const
+{
+    int cx,cy,cz;
+    cellOf(p,cx,cy,cz);
+
+    float limit=distance*distance;
+
+    for(int z=qMax(cz-1,0);z<=qMin(cz+1,zCells-1);++z)
+        for(int y=qMax(cy-1,0);y<=qMin(cy+1,yCells-1);++y)
+            for(int x=qMax(cx-1,0);x<=qMin(cx+1,xCells-1);++x)
+            {
+                const std::vector<GGL::Point3f> &cell=cells[x+y*xCells+z*xCells*yCells];
+
+                for(size_t i=0;i<cell.size();++i)
+                {
+                    GGL::Point3f d=cell[i]-p;
+
+                    if(d*d<limit)
+                        return false;
+                }
+            }
+
+    return true;
+}
+
+//stops a line where the field vanishes or where it runs into a placed line
+struct SeparationTerminate
+{
+    const SeparationGrid &grid;
+    float distance;
+
+    SeparationTerminate(const SeparationGrid &_grid,float _distance):grid(_grid),distance(_distance)
+    {}
+
+    bool operator()(const GGL::Point3f &from,const GGL::Point3f &to) const
+    {
+        return (to-from).length()<0.00001f || !grid.isFree(to,distance);
+    };
+};
+
+EvenlySpacedSeeder::EvenlySpacedSeeder(float _separation,float _testDistance,int _level):separation(_separation),level(_level),samples(0)
+{
+    testDistance=qMin(_testDistance,separation);
+}
+
+bool EvenlySpacedSeeder::traceLine(const GGL::Point3f &seed,const SeparationGrid &grid,std::vector<GGL::Point3f> &points,int &lineSamples,int &lineFetches)
+{
+    CellSampler sampler(level);
+    SeparationTerminate stop(grid,testDistance);
+
+    std::vector<GGL::Point3f> backward;
+    std::vector<GGL::Point3f> forward;
+
+    rk4Trace<BackwardIntegration>(seed,maxSteps,SpeedScaledStep(),sampler,stop,backward);
+    rk4Trace<ForwardIntegration>(seed,maxSteps,SpeedScaledStep(),sampler,stop,forward);
+
+    samples+=sampler.getSamples();
+    lineSamples=sampler.getSamples();
+    lineFetches=sampler.getFetches();
+
+    //backward from the far end to the seed, then on forward without the seed again
+    points.assign(backward.rbegin(),backward.rend());
+    points.insert(points.end(),forward.begin()+1,forward.end());
+
+    float length=0.0f;
+
+    for(size_t i=1;i<points.size() && length<separation;++i)
+        length+=(points[i]-points[i-1]).length();
+
+    //a stub shorter than the separation only adds clutter
+    return length>=separation;
+}
+
+int EvenlySpacedSeeder::generate(StreamlineStore &output,int maxLines)
+{
+    VectorField &field=VectorField::getSingleton();
+
+    if(field.xSize<2 || field.ySize<2 || field.zSize<2)
+        return 0;
+
+    GGL::Point3f upper((float)(field.xSize-1),(float)(field.ySize-1),(float)(field.zSize-1));
+
+    SeparationGrid grid(upper.X(),upper.Y(),upper.Z(),separation);
+
+    int first=output.getLineCount();
+    int next=first;
+
+    std::vector<GGL::Point3f> points;
+    std::vector<GGL::Point3f> line;
+    std::vector<GGL::Point3f> candidates;
+    int lineSamples;
+    int lineFetches;
+
+    //the first seed is the center, once the lines placed so far offer no free spot random seeds
+    //look for regions they never reach
+    GGL::Point3f seed=upper*0.5f;
+    int attempts=0;
+
+    while(output.getLineCount()-first<maxLines && attempts<restartAttempts)
+    {
+        candidates.clear();
+
+        if(next<output.getLineCount())
+        {
+            //copied, output may grow while the candidates are traced
+            line.assign(output.getLine(next),output.getLine(next)+output.getLineSize(next));
+            ++next;
+
+            for(size_t i=0;i<line.size();++i)
+            {
+                GGL::Point3f tangent=line[qMin(i+1,line.size()-1)]-line[i>0?i-1:0];
+
+                if(tangent.length()==0.0f)
+                    continue;
+
+                tangent.Normalize();
+
+                GGL::Point3f axis=fabs(tangent.X())<0.9f?GGL::Point3f(1,0,0):GGL::Point3f(0,1,0);
+                GGL::Point3f u=(tangent^axis).Normalize();
+                GGL::Point3f v=tangent^u;
+
+                candidates.push_back(line[i]+u*separation);
+                candidates.push_back(line[i]-u*separation);
+                candidates.push_back(line[i]+v*separation);
+                candidates.push_back(line[i]-v*separation);
+            }
+        }
+        else
+        {
+            candidates.push_back(seed);
+
+            seed=GGL::Point3f((float)(rand()%6400)/6400.0f*upper.X(),
+                              (float)(rand()%6400)/6400.0f*upper.Y(),
+                              (float)(rand()%6400)/6400.0f*upper.Z());
+            ++attempts;
+        }
+
+        for(size_t i=0;i<candidates.size() && output.getLineCount()-first<maxLines;++i)
+        {
+            const GGL::Point3f &c=candidates[i];
+
+            if(c.X()<0.0f || c.Y()<0.0f || c.Z()<0.0f || c.X()>upper.X() || c.Y()>upper.Y() || c.Z()>upper.Z())
+                continue;
+
+            if(!grid.isFree(c,separation) || !traceLine(c,grid,points,lineSamples,lineFetches))
+                continue;
+
+            grid.insert(points);
+
+            output.appendLine(&points[0],(int)points.size(),lineSamples,lineFetches);
+        }
+    }
+
+    return output.getLineCount()-first;
+}
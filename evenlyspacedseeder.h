@@ -0,0 +1,57 @@
+#ifndef EVENLYSPACEDSEEDER_H
+#define EVENLYSPACEDSEEDER_H
+
+#include <vector>
+#include "Point3.h"
+#include "streamlinestore.h"
+
+//Uniform grid over the field bounds holding the points of the lines placed so far. The cell size
+//is the separation distance, so every point closer than that is in the 27 cells around a query.
+class SeparationGrid
+{
+    float cellSize;
+    int xCells;
+    int yCells;
+    int zCells;
+
+    std::vector<std::vector<GGL::Point3f> > cells;
+
+    void cellOf(const GGL::Point3f &p,int &x,int &y,int &z) const;
+
+public:
+    SeparationGrid(float xSize,float ySize,float zSize,float _cellSize);
+
+    void insert(const std::vector<GGL::Point3f> &points);
+
+    //true when no placed point lies within distance, distance<=cellSize
+    bool isFree(const GGL::Point3f &p,float distance) const;
+};
+
+//Jobard-Lefer placement. Every line is traced both ways from its seed until it comes closer than
+//the test distance to another line, and new seeds are taken at the separation distance beside the
+//accepted lines until no free spot is left, so lines cover the field evenly without overlapping.
+class EvenlySpacedSeeder
+{
+    float separation;
+    float testDistance;
+    int level;
+
+    int samples;
+
+    bool traceLine(const GGL::Point3f &seed,const SeparationGrid &grid,std::vector<GGL::Point3f> &points,int &lineSamples,int &lineFetches);
+
+public:
+    //distances in voxels, testDistance is clamped to separation
+    EvenlySpacedSeeder(float _separation,float _testDistance,int _level=0);
+
+    //appends the placed lines to output and returns their number
+    int generate(StreamlineStore &output,int maxLines=10000);
+
+    //field samples spent on all lines traced, including rejected ones
+    int getSampleCount()
+    {
+        return samples;
+    };
+};
+
+#endif // EVENLYSPACEDSEEDER_H
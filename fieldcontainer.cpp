@@ -0,0 +1,46 @@
+#include "fieldcontainer.h"
+#include "fieldreader.h"
+#include <QtCore/QFileInfo>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+//the sizes and offsets come from the file, a corrupt or truncated header must not reach the allocation
+//of the field (an int voxel count) or a pointer into the mapping
+static bool containerHeaderFits(const FieldContainerHeader &header,qint64 fileBytes)
+{
+    const qint64 vectorBytes=3*sizeof(float);
+
+    if(header.xSize<=0 || header.ySize<=0 || header.zSize<=0
+            || (qint64)header.xSize*header.ySize*header.zSize>INT_MAX)
+        return false;
+
+    qint64 fieldBytes=(qint64)header.xSize*header.ySize*header.zSize*vectorBytes;
+
+    //the payload is read as vectors, so it starts on a vector boundary after the header
+    if(header.payloadOffset<(qint64)sizeof(header) || header.payloadOffset%vectorBytes!=0
+            || header.payloadOffset>fileBytes-fieldBytes)
+        return false;
+
+    //the optional sections are checked against their own sizes when mapped, here only where they can start
+    return header.brickRangeOffset>=0 && header.brickRangeOffset%sizeof(float)==0
+            && header.pyramidOffset>=0 && header.pyramidOffset%sizeof(float)==0
+            && header.brickIndexOffset>=0 && header.brickedOffset>=0;
+}
+
+bool readFieldContainerHeader(const char *filename,FieldContainerHeader &header)
+{
+    FILE *fp=fopen(filename,"rb");
+
+    if(!fp)
+        return false;
+
+    bool result=fread(&header,sizeof(header),1,fp)==1;
+
+    fclose(fp);
+
+    //a container from a machine of the other byte order would need converting, it is refused instead
+    return result && memcmp(header.magic,"VFC1",4)==0 && header.version==fieldContainerVersion
+            && header.byteOrder==fieldContainerByteOrder && header.elementType==FieldFormat::Float32
+            && containerHeaderFits(header,QFileInfo(filename).size());
+}
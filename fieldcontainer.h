@@ -0,0 +1,47 @@
+#ifndef FIELDCONTAINER_H
+#define FIELDCONTAINER_H
+
+#include <QtCore/QtGlobal>
+
+//Header of a .vfc field container. Everything a load needs is in here, so opening one is reading
+//the header and mapping the file. All sections are native float data written by
+//VectorField::saveContainer, offsets are from the start of the file and 0 marks an absent section.
+struct FieldContainerHeader
+{
+    char magic[4];
+    int version;
+    int byteOrder;
+
+    int xSize;
+    int ySize;
+    int zSize;
+    int elementType;
+
+    float minMag;
+    float maxMag;
+
+    int brickBits;
+    int xBricks;
+    int yBricks;
+    int zBricks;
+
+    //levels after the full resolution one, sizes halve as in VectorField::buildPyramid
+    int pyramidLevels;
+    int reserved[2];
+
+    //x-fastest float triples, a multiple of 12 bytes into the file so it can be read as vectors
+    qint64 payloadOffset;
+    //min and max magnitude per brick, bricks in x-fastest order
+    qint64 brickRangeOffset;
+    qint64 pyramidOffset;
+    //brick to voxel offset table and the Z-order bricked copy it indexes
+    qint64 brickIndexOffset;
+    qint64 brickedOffset;
+};
+
+enum {fieldContainerVersion=1, fieldContainerByteOrder=0x01020304, fieldContainerPayloadOffset=12288};
+
+//false when the file is not a container this build can map, or its sizes and offsets do not fit the file
+bool readFieldContainerHeader(const char *filename,FieldContainerHeader &header);
+
+#endif // FIELDCONTAINER_H
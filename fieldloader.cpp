@@ -0,0 +1,96 @@
+#include "fieldloader.h"
+#include "VectorField.h"
+
+FieldLoader::FieldLoader(QObject *parent):QThread(parent),staging(NULL),xSize(0),ySize(0),zSize(0),firstStep(0),stepCount(1)
+{
+    connect(this,SIGNAL(finished()),this,SLOT(onFinished()));
+    connect(&VectorField::getSingleton(),SIGNAL(backgroundReadsEnded()),this,SLOT(onFinished()));
+}
+
+FieldLoader::~FieldLoader()
+{
+    cancel();
+    wait();
+
+    delete staging;
+}
+
+void FieldLoader::load(const QString &_filename,int _xSize,int _ySize,int _zSize,const QString &_dataName)
+{
+    loadSeries(_filename,0,1,_xSize,_ySize,_zSize,_dataName);
+}
+
+void FieldLoader::loadSeries(const QString &pattern,int _firstStep,int _stepCount,int _xSize,int _ySize,int _zSize,const QString &_dataName)
+{
+    cancel();
+    wait();
+
+    //the finished notification of the cancelled load may still be queued, its field is dropped here
+    delete staging;
+    staging=NULL;
+
+    filename=pattern;
+    dataName=_dataName;
+    xSize=_xSize;
+    ySize=_ySize;
+    zSize=_zSize;
+    firstStep=_firstStep;
+    stepCount=_stepCount;
+
+    start(VectorField::createStaging());
+}
+
+void FieldLoader::start(VectorField *field)
+{
+    staging=field;
+
+    //the staging field emits from the worker thread, the connection queues it to the GUI thread
+    connect(staging,SIGNAL(loadProgress(int)),this,SIGNAL(progress(int)));
+
+    QThread::start();
+}
+
+void FieldLoader::cancel()
+{
+    if(!staging)
+        return;
+
+    staging->loadCancelled=true;
+
+    //a load held back for a background job is dropped right away
+    if(!isRunning())
+        onFinished();
+}
+
+void FieldLoader::run()
+{
+    if(stepCount>1)
+        staging->initSeries(filename,firstStep,stepCount,xSize,ySize,zSize,dataName);
+    else
+        staging->init(filename.toLocal8Bit().constData(),xSize,ySize,zSize,dataName);
+}
+
+void FieldLoader::onFinished()
+{
+    //a newer load already started, its own notification will follow
+    if(isRunning() || !staging)
+        return;
+
+    //a job still samples the current field, backgroundReadsEnded brings this back
+    if(VectorField::getSingleton().isReadInBackground() && !staging->loadCancelled)
+        return;
+
+    VectorField *field=staging;
+    staging=NULL;
+
+    if(field->loadCancelled)
+    {
+        delete field;
+        emit cancelled();
+        return;
+    }
+
+    VectorField::getSingleton().publish(field);
+
+    emit loaded();
+}
@@ -0,0 +1,53 @@
+#ifndef FIELDLOADER_H
+#define FIELDLOADER_H
+
+#include <QtCore/QThread>
+#include <QtCore/QString>
+
+class VectorField;
+
+//Runs VectorField::init or initSeries on a worker thread against a private staging field.
+//When the load completes the staging field is published into the singleton on the GUI thread,
+//which emits dataUpdated, so nothing ever sees a half loaded field. Progress is reported in
+//percent, a load can be cancelled, and starting a new load cancels the one in flight. A load that
+//completes while a background job still reads the singleton waits for it before it is published.
+class FieldLoader:public QThread
+{
+    Q_OBJECT
+
+private:
+    VectorField *staging;
+
+    QString filename;
+    QString dataName;
+    int xSize;
+    int ySize;
+    int zSize;
+    int firstStep;
+    int stepCount;
+
+    void start(VectorField *field);
+
+protected:
+    void run();
+
+public:
+    FieldLoader(QObject *parent=0);
+    ~FieldLoader();
+
+    void load(const QString &_filename,int _xSize,int _ySize,int _zSize,const QString &_dataName);
+    void loadSeries(const QString &pattern,int _firstStep,int _stepCount,int _xSize,int _ySize,int _zSize,const QString &_dataName);
+
+signals:
+    void progress(int percent);
+    void loaded();
+    void cancelled();
+
+public slots:
+    void cancel();
+
+private slots:
+    void onFinished();
+};
+
+#endif // FIELDLOADER_H
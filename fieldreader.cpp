@@ -0,0 +1,314 @@
+#include "fieldreader.h"
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+#define FIELDREADER_SSE
+#include <emmintrin.h>
+#endif
+
+//elements converted per chunk, small enough that the swap, convert and clamp passes stay in cache
+static const int chunkElements=1<<16;
+
+int FieldFormat::elementBytes() const
+{
+    switch(type)
+    {
+    case Float64:
+        return 8;
+    case Int8:
+    case UInt8:
+        return 1;
+    case Int16:
+    case UInt16:
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+bool FieldFormat::isNative() const
+{
+    return type==Float32 && bigEndian==(Q_BYTE_ORDER==Q_BIG_ENDIAN) && !clampMin && !clampMax;
+}
+
+int FieldFormat::tag() const
+{
+    if(isNative())
+        return 0;
+
+    return 1+(int)type+(bigEndian?16:0)+(clampMin?32:0)+(clampMax?64:0);
+}
+
+static void swapBytes(char *data,int count,int elementBytes)
+{
+    int i=0;
+
+#ifdef FIELDREADER_SSE
+    __m128i *v=(__m128i *)data;
+    int blocks=count*elementBytes/16;
+
+    for(int b=0;b<blocks;++b)
+    {
+        __m128i x=_mm_loadu_si128(v+b);
+
+        if(elementBytes==2)
+        {
+            x=_mm_or_si128(_mm_slli_epi16(x,8),_mm_srli_epi16(x,8));
+        }
+        else
+        {
+            //64 bit elements swap their two words first, then every word is reversed like a 32 bit element
+            if(elementBytes==8)
+                x=_mm_shuffle_epi32(x,_MM_SHUFFLE(2,3,0,1));
+
+            x=_mm_or_si128(_mm_slli_epi16(x,8),_mm_srli_epi16(x,8));
+            x=_mm_shufflehi_epi16(_mm_shufflelo_epi16(x,_MM_SHUFFLE(2,3,0,1)),_MM_SHUFFLE(2,3,0,1));
+        }
+
+        _mm_storeu_si128(v+b,x);
+    }
+
+    i=blocks*16/elementBytes;
+#endif
+
+    for(;i<count;++i)
+    {
+        char *e=data+i*elementBytes;
+
+        for(int l=0,h=elementBytes-1;l<h;++l,--h)
+        {
+            char t=e[l];
+            e[l]=e[h];
+            e[h]=t;
+        }
+    }
+}
+
+template<class T> static void convertScalar(const char *source,int first,int count,float *target)
+{
+    const T *s=(const T *)source;
+
+    for(int i=first;i<count;++i)
+        target[i]=(float)s[i];
+}
+
+static void convertElements(FieldFormat::ElementType type,const char *source,int count,float *target)
+{
+    int i=0;
+
+#ifdef FIELDREADER_SSE
+    const __m128i zero=_mm_setzero_si128();
+
+    switch(type)
+    {
+    case FieldFormat::Float32:
+        memcpy(target,source,count*sizeof(float));
+        return;
+    case FieldFormat::Float64:
+        for(;i+4<=count;i+=4)
+        {
+            __m128 lo=_mm_cvtpd_ps(_mm_loadu_pd((const double *)source+i));
+            __m128 hi=_mm_cvtpd_ps(_mm_loadu_pd((const double *)source+i+2));
+            _mm_storeu_ps(target+i,_mm_movelh_ps(lo,hi));
+        }
+        break;
+    case FieldFormat::Int32:
+        for(;i+4<=count;i+=4)
+            _mm_storeu_ps(target+i,_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(source+i*4))));
+        break;
+    case FieldFormat::UInt32:
+        //no unsigned conversion in SSE2, the two 16 bit halves are converted separately
+        for(;i+4<=count;i+=4)
+        {
+            __m128i x=_mm_loadu_si128((const __m128i *)(source+i*4));
+            __m128 hi=_mm_cvtepi32_ps(_mm_srli_epi32(x,16));
+            __m128 lo=_mm_cvtepi32_ps(_mm_and_si128(x,_mm_set1_epi32(0xffff)));
+            _mm_storeu_ps(target+i,_mm_add_ps(_mm_mul_ps(hi,_mm_set1_ps(65536.0f)),lo));
+        }
+        break;
+    case FieldFormat::Int16:
+    case FieldFormat::UInt16:
+        for(;i+8<=count;i+=8)
+        {
+            __m128i x=_mm_loadu_si128((const __m128i *)(source+i*2));
+            __m128i lo,hi;
+
+            if(type==FieldFormat::Int16)
+            {
+                lo=_mm_srai_epi32(_mm_unpacklo_epi16(x,x),16);
+                hi=_mm_srai_epi32(_mm_unpackhi_epi16(x,x),16);
+            }
+            else
+            {
+                lo=_mm_unpacklo_epi16(x,zero);
+                hi=_mm_unpackhi_epi16(x,zero);
+            }
+
+            _mm_storeu_ps(target+i,_mm_cvtepi32_ps(lo));
+            _mm_storeu_ps(target+i+4,_mm_cvtepi32_ps(hi));
+        }
+        break;
+    case FieldFormat::Int8:
+    case FieldFormat::UInt8:
+        for(;i+16<=count;i+=16)
+        {
+            __m128i x=_mm_loadu_si128((const __m128i *)(source+i));
+            __m128i lo,hi;
+
+            if(type==FieldFormat::Int8)
+            {
+                lo=_mm_srai_epi16(_mm_unpacklo_epi8(x,x),8);
+                hi=_mm_srai_epi16(_mm_unpackhi_epi8(x,x),8);
+
+                _mm_storeu_ps(target+i,_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(lo,lo),16)));
+                _mm_storeu_ps(target+i+4,_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(lo,lo),16)));
+                _mm_storeu_ps(target+i+8,_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(hi,hi),16)));
+                _mm_storeu_ps(target+i+12,_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(hi,hi),16)));
+            }
+            else
+            {
+                lo=_mm_unpacklo_epi8(x,zero);
+                hi=_mm_unpackhi_epi8(x,zero);
+
+                _mm_storeu_ps(target+i,_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo,zero)));
+                _mm_storeu_ps(target+i+4,_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo,zero)));
+                _mm_storeu_ps(target+i+8,_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi,zero)));
+                _mm_storeu_ps(target+i+12,_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi,zero)));
+            }
+        }
+        break;
+    }
+#endif
+
+    switch(type)
+    {
+    case FieldFormat::Float32:
+        convertScalar<float>(source,i,count,target);
+        break;
+    case FieldFormat::Float64:
+        convertScalar<double>(source,i,count,target);
+        break;
+    case FieldFormat::Int8:
+        convertScalar<signed char>(source,i,count,target);
+        break;
+    case FieldFormat::UInt8:
+        convertScalar<unsigned char>(source,i,count,target);
+        break;
+    case FieldFormat::Int16:
+        convertScalar<short>(source,i,count,target);
+        break;
+    case FieldFormat::UInt16:
+        convertScalar<unsigned short>(source,i,count,target);
+        break;
+    case FieldFormat::Int32:
+        convertScalar<int>(source,i,count,target);
+        break;
+    case FieldFormat::UInt32:
+        convertScalar<unsigned int>(source,i,count,target);
+        break;
+    }
+}
+
+static void clampValues(float *data,int count,float minValue,float maxValue)
+{
+    int i=0;
+
+#ifdef FIELDREADER_SSE
+    __m128 lo=_mm_set1_ps(minValue);
+    __m128 hi=_mm_set1_ps(maxValue);
+
+    for(;i+4<=count;i+=4)
+        _mm_storeu_ps(data+i,_mm_min_ps(_mm_max_ps(_mm_loadu_ps(data+i),lo),hi));
+#endif
+
+    for(;i<count;++i)
+        data[i]=qBound(minValue,data[i],maxValue);
+}
+
+void FieldReader::convert(const FieldFormat &format,char *source,int count,float *target)
+{
+    if(format.elementBytes()>1 && format.bigEndian!=(Q_BYTE_ORDER==Q_BIG_ENDIAN))
+        swapBytes(source,count,format.elementBytes());
+
+    convertElements(format.type,source,count,target);
+
+    if(format.clampMin || format.clampMax)
+        clampValues(target,count,format.clampMin?format.minValue:-3.402823466e+38f,format.clampMax?format.maxValue:3.402823466e+38f);
+}
+
+FieldReader::FieldReader(const FieldFormat &_format):format(_format),fp(NULL)
+{
+}
+
+FieldReader::~FieldReader()
+{
+    close();
+}
+
+bool FieldReader::open(const char *filename,qint64 firstVector)
+{
+    close();
+
+    fp=fopen(filename,"rb");
+
+    if(!fp)
+        return false;
+
+    //fseek takes a long, which is 32 bit on Windows, so long offsets are reached in steps
+    qint64 offset=firstVector*3*format.elementBytes();
+
+    if(fseek(fp,0,SEEK_SET)!=0)
+        return false;
+
+    while(offset>0)
+    {
+        long step=(long)qMin(offset,(qint64)0x40000000);
+
+        if(fseek(fp,step,SEEK_CUR)!=0)
+        {
+            close();
+            return false;
+        }
+
+        offset-=step;
+    }
+
+    return true;
+}
+
+void FieldReader::close()
+{
+    if(fp)
+        fclose(fp);
+
+    fp=NULL;
+}
+
+int FieldReader::read(float *target,int count)
+{
+    if(!fp)
+        return 0;
+
+    int elementBytes=format.elementBytes();
+    int total=count*3;
+    int done=0;
+
+    if(format.isNative())
+        return (int)(fread(target,sizeof(float)*3,count,fp));
+
+    chunk.resize(chunkElements*elementBytes);
+
+    while(done<total)
+    {
+        int elements=qMin(chunkElements,total-done);
+        int got=(int)fread(&chunk[0],elementBytes,elements,fp);
+
+        convert(format,&chunk[0],got,target+done);
+        done+=got;
+
+        if(got<elements)
+            break;
+    }
+
+    return done/3;
+}
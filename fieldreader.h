@@ -0,0 +1,56 @@
+#ifndef FIELDREADER_H
+#define FIELDREADER_H
+
+#include <stdio.h>
+#include <vector>
+#include <QtCore/QtGlobal>
+
+//How the vectors of a raw field file are stored. The default is what .vec files have always
+//been, native float triples with nothing clamped.
+struct FieldFormat
+{
+    enum ElementType {Float32, Float64, Int8, UInt8, Int16, UInt16, Int32, UInt32};
+
+    ElementType type;
+    bool bigEndian;
+    bool clampMin;
+    bool clampMax;
+    float minValue;
+    float maxValue;
+
+    FieldFormat():type(Float32),bigEndian(Q_BYTE_ORDER==Q_BIG_ENDIAN),clampMin(false),clampMax(false),minValue(0.0f),maxValue(0.0f)
+    {}
+
+    int elementBytes() const;
+
+    //the file can be mapped and used as it is
+    bool isNative() const;
+
+    //identifies the conversion, kept with data derived from the file so a stale copy is noticed
+    int tag() const;
+};
+
+//Streams a raw field file as float triples, converting element type and byte order and clamping
+//one chunk at a time so the file is read exactly once and no full size temporary is needed.
+class FieldReader
+{
+    FieldFormat format;
+    FILE *fp;
+    std::vector<char> chunk;
+
+public:
+    FieldReader(const FieldFormat &_format);
+    ~FieldReader();
+
+    //firstVector is counted in vectors, so a frame or slice further into the file can be read directly
+    bool open(const char *filename,qint64 firstVector=0);
+    void close();
+
+    //returns how many of the count vectors were read
+    int read(float *target,int count);
+
+    //converts count elements of source into target, source is byte swapped in place on the way
+    static void convert(const FieldFormat &format,char *source,int count,float *target);
+};
+
+#endif // FIELDREADER_H
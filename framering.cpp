@@ -0,0 +1,222 @@
+#include "framering.h"
+#include <string.h>
+#include <QtCore/QtConcurrentRun>
+
+FrameRing::FrameRing():firstStep(0),stepCount(0),voxelCount(0),outstanding(0),stalls(0),prefetched(0)
+{
+}
+
+FrameRing::~FrameRing()
+{
+    close();
+}
+
+bool FrameRing::open(const QString &_pattern,const FieldFormat &_format,int _firstStep,int _stepCount,int xSize,int ySize,int zSize,int ringSize)
+{
+    close();
+
+    if(_stepCount<1)
+        return false;
+
+    pattern=_pattern;
+    format=_format;
+    firstStep=_firstStep;
+    stepCount=_stepCount;
+    voxelCount=xSize*ySize*zSize;
+
+    ring.resize(qBound(3,ringSize,qMax(3,stepCount)));
+
+    for(size_t i=0;i<ring.size();++i)
+    {
+        ring[i].frame=-1;
+        ring[i].pins=0;
+        ring[i].ready=true;
+        ring[i].data=new float[voxelCount*3];
+    }
+
+    stalls=prefetched=0;
+
+    return true;
+}
+
+void FrameRing::close()
+{
+    mutex.lock();
+
+    while(outstanding>0)
+        frameReady.wait(&mutex);
+
+    mutex.unlock();
+
+    for(size_t i=0;i<ring.size();++i)
+        delete [] ring[i].data;
+
+    ring.clear();
+    stepCount=0;
+}
+
+bool FrameRing::readFrame(int frame,float *target)
+{
+    qint64 firstVector=0;
+    QString filename=pattern;
+
+    if(pattern.contains('%'))
+        filename.sprintf(pattern.toLocal8Bit().constData(),firstStep+frame);
+    else
+        firstVector=(qint64)frame*voxelCount;
+
+    FieldReader reader(format);
+
+    bool result=reader.open(filename.toLocal8Bit().constData(),firstVector) && reader.read(target,voxelCount)==voxelCount;
+
+    //a missing frame reads as a zero field rather than stopping playback
+    if(!result)
+        memset(target,0,(size_t)voxelCount*3*sizeof(float));
+
+    return result;
+}
+
+int FrameRing::findSlot(int frame)
+{
+    for(size_t i=0;i<ring.size();++i)
+        if(ring[i].frame==frame)
+            return (int)i;
+
+    return -1;
+}
+
+int FrameRing::claimSlot(int keepFrom,int keepTo)
+{
+    //empty ring first, then frames already passed, then the frame furthest ahead
+    int best=-1;
+    int bestScore=0;
+
+    for(size_t i=0;i<ring.size();++i)
+    {
+        const Slot &s=ring[i];
+
+        if(s.pins>0 || !s.ready || (s.frame>=keepFrom && s.frame<=keepTo))
+            continue;
+
+        int score;
+
+        if(s.frame<0)
+            score=3*stepCount;
+        else if(s.frame<keepFrom)
+            score=2*stepCount+keepFrom-s.frame;
+        else
+            score=s.frame-keepTo;
+
+        if(score>bestScore)
+        {
+            best=(int)i;
+            bestScore=score;
+        }
+    }
+
+    return best;
+}
+
+const float *FrameRing::acquire(int frame)
+{
+    frame=qBound(0,frame,stepCount-1);
+
+    QMutexLocker locker(&mutex);
+
+    int slot;
+
+    for(;;)
+    {
+        slot=findSlot(frame);
+
+        if(slot>=0)
+        {
+            if(ring[slot].ready)
+            {
+                ++ring[slot].pins;
+                break;
+            }
+
+            frameReady.wait(&mutex);
+            continue;
+        }
+
+        //a miss, the frame is read on this thread while the others keep sampling
+        slot=claimSlot(frame,frame+1);
+
+        if(slot<0)
+            slot=claimSlot(frame,frame);
+
+        if(slot<0)
+        {
+            frameReady.wait(&mutex);
+            continue;
+        }
+
+        Slot &s=ring[slot];
+        s.frame=frame;
+        s.ready=false;
+        s.pins=1;
+        ++stalls;
+
+        locker.unlock();
+        readFrame(frame,s.data);
+        locker.relock();
+
+        s.ready=true;
+        frameReady.wakeAll();
+        break;
+    }
+
+    //keep the rest of the ring filled with the frames that come next
+    int last=qMin(stepCount-1,frame+(int)ring.size()-2);
+
+    for(int ahead=frame+1;ahead<=last;++ahead)
+    {
+        if(findSlot(ahead)>=0)
+            continue;
+
+        int target=claimSlot(frame,ahead);
+
+        if(target<0)
+            break;
+
+        ring[target].frame=ahead;
+        ring[target].ready=false;
+        ++outstanding;
+
+        QtConcurrent::run(this,&FrameRing::prefetchFrame,target);
+    }
+
+    return ring[slot].data;
+}
+
+void FrameRing::release(int frame)
+{
+    frame=qBound(0,frame,stepCount-1);
+
+    QMutexLocker locker(&mutex);
+
+    int slot=findSlot(frame);
+
+    if(slot>=0 && ring[slot].pins>0)
+    {
+        --ring[slot].pins;
+
+        if(ring[slot].pins==0)
+            frameReady.wakeAll();
+    }
+}
+
+void FrameRing::prefetchFrame(int slot)
+{
+    readFrame(ring[slot].frame,ring[slot].data);
+
+    QMutexLocker locker(&mutex);
+
+    ring[slot].ready=true;
+    ++prefetched;
+
+    --outstanding;
+    frameReady.wakeAll();
+}
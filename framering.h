@@ -0,0 +1,77 @@
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include <vector>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+#include <QtCore/QString>
+#include "fieldreader.h"
+
+//Keeps a small ring of timesteps of a time-varying field resident. A frame is either its own
+//file, named by a printf pattern taking the step number, or a slice of one file holding all steps
+//back to back. acquire() pins a frame and queues the frames after it for loading on the global
+//thread pool, so a reader moving forward in time finds them resident. All entry points are thread safe.
+class FrameRing
+{
+    struct Slot
+    {
+        int frame;
+        int pins;
+        bool ready;
+        float *data;
+    };
+
+    QMutex mutex;
+    QWaitCondition frameReady;
+
+    QString pattern;
+    FieldFormat format;
+    int firstStep;
+    int stepCount;
+    int voxelCount;
+
+    std::vector<Slot> ring;
+    int outstanding;
+
+    unsigned int stalls;
+    unsigned int prefetched;
+
+    int findSlot(int frame);
+    int claimSlot(int keepFrom,int keepTo);
+    bool readFrame(int frame,float *target);
+    void prefetchFrame(int slot);
+
+public:
+    FrameRing();
+    ~FrameRing();
+
+    //ringSize is clamped to at least 3, the pair being interpolated plus one frame ahead
+    bool open(const QString &_pattern,const FieldFormat &_format,int _firstStep,int _stepCount,int xSize,int ySize,int zSize,int ringSize);
+    void close();
+
+    int getStepCount()
+    {
+        return stepCount;
+    };
+
+    //x-fastest xyz floats of frame 0..stepCount-1, valid until the matching release
+    const float *acquire(int frame);
+    void release(int frame);
+
+    unsigned int getStalls()
+    {
+        return stalls;
+    };
+
+    unsigned int getPrefetched()
+    {
+        return prefetched;
+    };
+
+    int getRingSize()
+    {
+        return (int)ring.size();
+    };
+};
+
+#endif // FRAMERING_H
@@ -0,0 +1,369 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include <vector>
+#include <math.h>
+#include "Point3.h"
+#include "VectorField.h"
+
+//Integration kernels shared by every tracer. Direction, step rule, field sampler and termination
+//test are template parameters, so each tracer gets its own fully inlined loop and the field
+//singleton is looked up once per line instead of once per stage.
+
+//direction policies
+struct ForwardIntegration
+{
+    static float sign()
+    {
+        return 1.0f;
+    };
+};
+
+struct BackwardIntegration
+{
+    static float sign()
+    {
+        return -1.0f;
+    };
+};
+
+//RK4 step policies, the time step from the field at the start of the step
+struct SpeedScaledStep
+{
+    //about 1.5 voxels per step, slow regions are capped at a time step of 1.5
+    float operator()(const GGL::Point3f &v) const
+    {
+        float deltaT=1.5f/v.length();
+        return deltaT>2.0f?1.5f:deltaT;
+    };
+};
+
+struct FixedStep
+{
+    float deltaT;
+
+    explicit FixedStep(float _deltaT):deltaT(_deltaT)
+    {}
+
+    float operator()(const GGL::Point3f &) const
+    {
+        return deltaT;
+    };
+};
+
+//Dormand-Prince step policy, tolerance is the largest position error accepted per step and the
+//step length is kept within [minStep,maxStep], all in voxels
+struct AdaptiveStep
+{
+    float tolerance;
+    float minStep;
+    float maxStep;
+
+    AdaptiveStep(float _tolerance,float _minStep=0.01f,float _maxStep=4.0f):tolerance(_tolerance),minStep(_minStep),maxStep(_maxStep)
+    {}
+};
+
+//samplers
+struct FieldSampler
+{
+    VectorField &field;
+
+    FieldSampler():field(VectorField::getSingleton())
+    {}
+
+    GGL::Point3f operator()(const GGL::Point3f &p) const
+    {
+        return field.getVector(p.X(),p.Y(),p.Z());
+    };
+};
+
+struct LevelSampler
+{
+    VectorField &field;
+    int level;
+
+    explicit LevelSampler(int _level):field(VectorField::getSingleton()),level(_level)
+    {}
+
+    GGL::Point3f operator()(const GGL::Point3f &p) const
+    {
+        return field.getVector(p.X(),p.Y(),p.Z(),level);
+    };
+};
+
+//Keeps the 8 corners of the cell sampled last. Stages and steps that stay inside that cell are
+//interpolated from the copy, only leaving the cell locates and loads the corners again. Samples
+//the same values as getVector on the same level.
+class CellSampler
+{
+    VectorField &field;
+    int level;
+
+    float maxX;
+    float maxY;
+    float maxZ;
+
+    //level coordinate = (full resolution coordinate - offset) * scale
+    float scale;
+    float offset;
+
+    int lastX;
+    int lastY;
+    int lastZ;
+
+    int cellX;
+    int cellY;
+    int cellZ;
+    float corners[24];
+
+    unsigned int samples;
+    unsigned int fetches;
+
+    void fetch(float x,float y,float z)
+    {
+        //a position on the far faces is the end of the last cell, as in getVector
+        cellX=qMin((int)x,lastX-1);
+        cellY=qMin((int)y,lastY-1);
+        cellZ=qMin((int)z,lastZ-1);
+
+        field.getCellCorners(level,cellX,cellY,cellZ,corners);
+        ++fetches;
+    };
+
+public:
+    explicit CellSampler(int _level=0):field(VectorField::getSingleton()),cellX(-2),cellY(-2),cellZ(-2),samples(0),fetches(0)
+    {
+        level=qBound(0,_level,field.getLevelCount()-1);
+
+        int x,y,z;
+        field.getLevelSize(level,x,y,z);
+
+        lastX=x-1;
+        lastY=y-1;
+        lastZ=z-1;
+
+        maxX=(float)(field.xSize-1);
+        maxY=(float)(field.ySize-1);
+        maxZ=(float)(field.zSize-1);
+
+        scale=1.0f/(float)(1<<level);
+        offset=0.5f*((float)(1<<level)-1.0f);
+    };
+
+    GGL::Point3f operator()(const GGL::Point3f &p)
+    {
+        ++samples;
+
+        float x=p.X();
+        float y=p.Y();
+        float z=p.Z();
+
+        if(x>maxX || x<0.0f || y>maxY || y<0.0f || z>maxZ || z<0.0f)
+            return GGL::Point3f(0,0,0);
+
+        if(level>0)
+        {
+            x=qBound(0.0f,(x-offset)*scale,(float)lastX);
+            y=qBound(0.0f,(y-offset)*scale,(float)lastY);
+            z=qBound(0.0f,(z-offset)*scale,(float)lastZ);
+        }
+
+        float xd=x-cellX;
+        float yd=y-cellY;
+        float zd=z-cellZ;
+
+        if(xd<0.0f || xd>1.0f || yd<0.0f || yd>1.0f || zd<0.0f || zd>1.0f)
+        {
+            fetch(x,y,z);
+
+            xd=x-cellX;
+            yd=y-cellY;
+            zd=z-cellZ;
+        }
+
+        return VectorField::interpolateCell(corners,xd,yd,zd);
+    };
+
+    unsigned int getSamples() const
+    {
+        return samples;
+    };
+
+    //corner loads, every one reads 8 vectors from the active layout
+    unsigned int getFetches() const
+    {
+        return fetches;
+    };
+};
+
+template<class Sampler>
+struct CountingSampler
+{
+    Sampler sampler;
+    int &count;
+
+    CountingSampler(const Sampler &_sampler,int &_count):sampler(_sampler),count(_count)
+    {}
+
+    GGL::Point3f operator()(const GGL::Point3f &p)
+    {
+        ++count;
+        return sampler(p);
+    };
+};
+
+//unit length direction, zero outside the field or at a critical point
+template<class Sampler>
+struct NormalizedSampler
+{
+    Sampler &sampler;
+
+    explicit NormalizedSampler(Sampler &_sampler):sampler(_sampler)
+    {}
+
+    GGL::Point3f operator()(const GGL::Point3f &p)
+    {
+        GGL::Point3f dir=sampler(p);
+        float length=dir.length();
+
+        if(length<0.00001f)
+            return GGL::Point3f(0,0,0);
+
+        return dir*(1.0f/length);
+    };
+};
+
+//termination policies, asked with the positions before and after every step
+struct NeverTerminate
+{
+    bool operator()(const GGL::Point3f &,const GGL::Point3f &) const
+    {
+        return false;
+    };
+};
+
+struct TerminateWhenStalled
+{
+    bool operator()(const GGL::Point3f &from,const GGL::Point3f &to) const
+    {
+        return (to-from).length()<0.00001f;
+    };
+};
+
+//one classic RK4 step
+template<class Direction,class StepPolicy,class Sampler>
+inline GGL::Point3f rk4Step(const GGL::Point3f &pos,const StepPolicy &stepPolicy,Sampler &sampler)
+{
+    GGL::Point3f dir=sampler(pos);
+
+    float deltaT=stepPolicy(dir)*Direction::sign();
+
+    GGL::Point3f k1=dir*deltaT;
+    GGL::Point3f k2=sampler(pos+k1*0.5f)*deltaT;
+    GGL::Point3f k3=sampler(pos+k2*0.5f)*deltaT;
+    GGL::Point3f k4=sampler(pos+k3)*deltaT;
+
+    return pos+(k1+k2*2.0f+k3*2.0f+k4)*(1.0f/6.0f);
+}
+
+//up to maxSteps RK4 steps from start, every point is appended to points including start
+template<class Direction,class StepPolicy,class Sampler,class Termination>
+inline int rk4Trace(const GGL::Point3f &start,int maxSteps,const StepPolicy &stepPolicy,Sampler &sampler,Termination &terminate,std::vector<GGL::Point3f> &points)
+{
+    GGL::Point3f current=start;
+
+    points.push_back(current);
+
+    int steps=0;
+
+    for(;steps<maxSteps;++steps)
+    {
+        GGL::Point3f next=rk4Step<Direction>(current,stepPolicy,sampler);
+
+        if(terminate(current,next))
+            break;
+
+        current=next;
+        points.push_back(current);
+    }
+
+    return steps;
+}
+
+//One Dormand-Prince 5(4) step of length h along a normalized sampler. k1 is the direction at pos,
+//on success it holds the direction at the new position since the last stage of an accepted step
+//is the first of the next. h always comes back as the size to try next.
+template<class Direction,class Sampler>
+inline bool dormandPrinceStep(GGL::Point3f &pos,GGL::Point3f &k1,float &h,const AdaptiveStep &stepPolicy,Sampler &sampler)
+{
+    float s=h*Direction::sign();
+
+    GGL::Point3f k2=sampler(pos+k1*(s*(1.0f/5.0f)));
+    GGL::Point3f k3=sampler(pos+(k1*(3.0f/40.0f)+k2*(9.0f/40.0f))*s);
+    GGL::Point3f k4=sampler(pos+(k1*(44.0f/45.0f)+k2*(-56.0f/15.0f)+k3*(32.0f/9.0f))*s);
+    GGL::Point3f k5=sampler(pos+(k1*(19372.0f/6561.0f)+k2*(-25360.0f/2187.0f)+k3*(64448.0f/6561.0f)+k4*(-212.0f/729.0f))*s);
+    GGL::Point3f k6=sampler(pos+(k1*(9017.0f/3168.0f)+k2*(-355.0f/33.0f)+k3*(46732.0f/5247.0f)+k4*(49.0f/176.0f)+k5*(-5103.0f/18656.0f))*s);
+
+    GGL::Point3f next=pos+(k1*(35.0f/384.0f)+k3*(500.0f/1113.0f)+k4*(125.0f/192.0f)+k5*(-2187.0f/6784.0f)+k6*(11.0f/84.0f))*s;
+    GGL::Point3f k7=sampler(next);
+
+    //difference between the 5th and the embedded 4th order solution
+    GGL::Point3f delta=(k1*(71.0f/57600.0f)+k3*(-71.0f/16695.0f)+k4*(71.0f/1920.0f)+k5*(-17253.0f/339200.0f)+k6*(22.0f/525.0f)+k7*(-1.0f/40.0f))*s;
+
+    float error=qMax(qMax(fabs(delta.X()),fabs(delta.Y())),fabs(delta.Z()));
+
+    float factor=error>0.0f?0.9f*pow(stepPolicy.tolerance/error,0.2f):5.0f;
+    float size=h;
+
+    h=qBound(stepPolicy.minStep,h*qBound(0.2f,factor,5.0f),stepPolicy.maxStep);
+
+    if(error>stepPolicy.tolerance && size>stepPolicy.minStep)
+        return false;
+
+    pos=next;
+    k1=k7;
+
+    return true;
+}
+
+//adaptive steps from start until the line is maxLength long, the last step is shortened so
+//every line ends at the same length. Points are appended as for rk4Trace.
+template<class Direction,class Sampler,class Termination>
+inline int dormandPrinceTrace(const GGL::Point3f &start,float maxLength,int maxSteps,const AdaptiveStep &stepPolicy,Sampler &sampler,Termination &terminate,std::vector<GGL::Point3f> &points)
+{
+    NormalizedSampler<Sampler> direction(sampler);
+
+    GGL::Point3f current=start;
+    GGL::Point3f k1=direction(current);
+
+    points.push_back(current);
+
+    float h=1.0f;
+    float length=0.0f;
+    int steps=0;
+
+    for(int i=0;i<maxSteps && length<maxLength;++i)
+    {
+        if(k1.length()==0.0f)
+            break;
+
+        h=qMin(h,maxLength-length);
+
+        GGL::Point3f next=current;
+
+        if(!dormandPrinceStep<Direction>(next,k1,h,stepPolicy,direction))
+            continue;
+
+        if(terminate(current,next))
+            break;
+
+        length+=(next-current).length();
+        current=next;
+        points.push_back(current);
+        ++steps;
+    }
+
+    return steps;
+}
+
+#endif // INTEGRATOR_H
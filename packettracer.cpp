@@ -0,0 +1,425 @@
+#include "packettracer.h"
+#include "VectorField.h"
+#include "earlytermination.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+#define PACKETTRACER_SSE
+#include <emmintrin.h>
+#endif
+
+//the maximum number of steps of a line, as in Streamline::generate
+static const int maxSteps=500;
+
+//four lanes, SSE registers when available and plain floats otherwise. The operations are the
+//ones the scalar kernel does in the same order, so every lane rounds exactly like it.
+#ifdef PACKETTRACER_SSE
+
+struct Lanes
+{
+    __m128 v;
+};
+
+static inline Lanes lanes(__m128 v)
+{
+    Lanes r;
+    r.v=v;
+    return r;
+}
+
+static inline Lanes load(const float *p)
+{
+    return lanes(_mm_loadu_ps(p));
+}
+
+static inline void store(float *p,const Lanes &a)
+{
+    _mm_storeu_ps(p,a.v);
+}
+
+static inline Lanes splat(float v)
+{
+    return lanes(_mm_set1_ps(v));
+}
+
+static inline Lanes operator+(const Lanes &a,const Lanes &b)
+{
+    return lanes(_mm_add_ps(a.v,b.v));
+}
+
+static inline Lanes operator-(const Lanes &a,const Lanes &b)
+{
+    return lanes(_mm_sub_ps(a.v,b.v));
+}
+
+static inline Lanes operator*(const Lanes &a,const Lanes &b)
+{
+    return lanes(_mm_mul_ps(a.v,b.v));
+}
+
+static inline Lanes operator/(const Lanes &a,const Lanes &b)
+{
+    return lanes(_mm_div_ps(a.v,b.v));
+}
+
+static inline Lanes root(const Lanes &a)
+{
+    return lanes(_mm_sqrt_ps(a.v));
+}
+
+//a>limit?replacement:a per lane
+static inline Lanes replaceAbove(const Lanes &a,const Lanes &limit,const Lanes &replacement)
+{
+    __m128 above=_mm_cmpgt_ps(a.v,limit.v);
+    return lanes(_mm_or_ps(_mm_and_ps(above,replacement.v),_mm_andnot_ps(above,a.v)));
+}
+
+#else
+
+struct Lanes
+{
+    float v[4];
+};
+
+static inline Lanes load(const float *p)
+{
+    Lanes r;
+    for(int i=0;i<4;++i) r.v[i]=p[i];
+    return r;
+}
+
+static inline void store(float *p,const Lanes &a)
+{
+    for(int i=0;i<4;++i) p[i]=a.v[i];
+}
+
+static inline Lanes splat(float v)
+{
+    Lanes r;
+    for(int i=0;i<4;++i) r.v[i]=v;
+    return r;
+}
+
+static inline Lanes operator+(const Lanes &a,const Lanes &b)
+{
+    Lanes r;
+    for(int i=0;i<4;++i) r.v[i]=a.v[i]+b.v[i];
+    return r;
+}
+
+static inline Lanes operator-(const Lanes &a,const Lanes &b)
+{
+    Lanes r;
+    for(int i=0;i<4;++i) r.v[i]=a.v[i]-b.v[i];
+    return r;
+}
+
+static inline Lanes operator*(const Lanes &a,const Lanes &b)
+{
+    Lanes r;
+    for(int i=0;i<4;++i) r.v[i]=a.v[i]*b.v[i];
+    return r;
+}
+
+static inline Lanes operator/(const Lanes &a,const Lanes &b)
+{
+    Lanes r;
+    for(int i=0;i<4;++i) r.v[i]=a.v[i]/b.v[i];
+    return r;
+}
+
+static inline Lanes root(const Lanes &a)
+{
+    Lanes r;
+    for(int i=0;i<4;++i) r.v[i]=sqrt(a.v[i]);
+    return r;
+}
+
+static inline Lanes replaceAbove(const Lanes &a,const Lanes &limit,const Lanes &replacement)
+{
+    Lanes r;
+    for(int i=0;i<4;++i) r.v[i]=a.v[i]>limit.v[i]?replacement.v[i]:a.v[i];
+    return r;
+}
+
+#endif
+
+PacketTracer::PacketTracer(const std::vector<GGL::Point3f> &_seeds,int _level):seeds(_seeds),field(VectorField::getSingleton())
+{
+    level=qBound(0,_level,field.getLevelCount()-1);
+
+    int sizeX,sizeY,sizeZ;
+    field.getLevelSize(level,sizeX,sizeY,sizeZ);
+
+    lastX=sizeX-1;
+    lastY=sizeY-1;
+    lastZ=sizeZ-1;
+
+    maxX=(float)(field.xSize-1);
+    maxY=(float)(field.ySize-1);
+    maxZ=(float)(field.zSize-1);
+
+    scale=1.0f/(float)(1<<level);
+    offset=0.5f*((float)(1<<level)-1.0f);
+
+    for(int lane=0;lane<laneCount;++lane)
+    {
+        active[lane]=false;
+        x[lane]=y[lane]=z[lane]=0.0f;
+
+        for(int k=0;k<24;++k)
+            corners[k][lane]=0.0f;
+
+        laneEnd[lane]=new EarlyTermination(lanePoints[lane],1.0f,maxSteps);
+    }
+}
+
+PacketTracer::~PacketTracer()
+{
+    for(int lane=0;lane<laneCount;++lane)
+        delete laneEnd[lane];
+}
+
+void PacketTracer::sample(const float *sx,const float *sy,const float *sz,float *vx,float *vy,float *vz)
+{
+    float xd[laneCount];
+    float yd[laneCount];
+    float zd[laneCount];
+    bool inside[laneCount];
+
+    //locating the cell is per lane, a lane that left its cell gathers the new corners
+    for(int lane=0;lane<laneCount;++lane)
+    {
+        float px=sx[lane];
+        float py=sy[lane];
+        float pz=sz[lane];
+
+        if(active[lane])
+            ++laneSamples[lane];
+
+        inside[lane]=active[lane] && px<=maxX && px>=0.0f && py<=maxY && py>=0.0f && pz<=maxZ && pz>=0.0f;
+
+        if(!inside[lane])
+        {
+            xd[lane]=yd[lane]=zd[lane]=0.0f;
+            continue;
+        }
+
+        if(level>0)
+        {
+            px=qBound(0.0f,(px-offset)*scale,(float)lastX);
+            py=qBound(0.0f,(py-offset)*scale,(float)lastY);
+            pz=qBound(0.0f,(pz-offset)*scale,(float)lastZ);
+        }
+
+        xd[lane]=px-cellX[lane];
+        yd[lane]=py-cellY[lane];
+        zd[lane]=pz-cellZ[lane];
+
+        if(xd[lane]<0.0f || xd[lane]>1.0f || yd[lane]<0.0f || yd[lane]>1.0f || zd[lane]<0.0f || zd[lane]>1.0f)
+        {
+            cellX[lane]=qMin((int)px,lastX-1);
+            cellY[lane]=qMin((int)py,lastY-1);
+            cellZ[lane]=qMin((int)pz,lastZ-1);
+
+            float cell[24];
+            field.getCellCorners(level,cellX[lane],cellY[lane],cellZ[lane],cell);
+
+            for(int k=0;k<24;++k)
+                corners[k][lane]=cell[k];
+
+            ++laneFetches[lane];
+
+            xd[lane]=px-cellX[lane];
+            yd[lane]=py-cellY[lane];
+            zd[lane]=pz-cellZ[lane];
+        }
+    }
+
+    float *out[3]={vx,vy,vz};
+    Lanes one=splat(1.0f);
+
+    for(int g=0;g<laneCount;g+=4)
+    {
+        Lanes tx=load(xd+g);
+        Lanes ty=load(yd+g);
+        Lanes tz=load(zd+g);
+        Lanes atx=one-tx;
+        Lanes aty=one-ty;
+        Lanes atz=one-tz;
+
+        for(int c=0;c<3;++c)
+        {
+            Lanes i1=load(corners[0+c]+g)*atz+load(corners[3+c]+g)*tz;
+            Lanes i2=load(corners[6+c]+g)*atz+load(corners[9+c]+g)*tz;
+            Lanes j1=load(corners[12+c]+g)*atz+load(corners[15+c]+g)*tz;
+            Lanes j2=load(corners[18+c]+g)*atz+load(corners[21+c]+g)*tz;
+
+            Lanes w1=i1*aty+i2*ty;
+            Lanes w2=j1*aty+j2*ty;
+
+            store(out[c]+g,w1*atx+w2*tx);
+        }
+    }
+
+    //outside the field the sample is zero, as in CellSampler
+    for(int lane=0;lane<laneCount;++lane)
+        if(!inside[lane])
+            vx[lane]=vy[lane]=vz[lane]=0.0f;
+}
+
+void PacketTracer::step(float *nx,float *ny,float *nz)
+{
+    float vx[laneCount],vy[laneCount],vz[laneCount];
+    float sx[laneCount],sy[laneCount],sz[laneCount];
+    float dt[laneCount];
+    float kx[3][laneCount],ky[3][laneCount],kz[3][laneCount];
+
+    Lanes half=splat(0.5f);
+    Lanes two=splat(2.0f);
+
+    sample(x,y,z,vx,vy,vz);
+
+    //k1 and the time step from the field at the start, as SpeedScaledStep
+    for(int g=0;g<laneCount;g+=4)
+    {
+        Lanes dx=load(vx+g);
+        Lanes dy=load(vy+g);
+        Lanes dz=load(vz+g);
+
+        Lanes deltaT=splat(1.5f)/root(dx*dx+dy*dy+dz*dz);
+        deltaT=replaceAbove(deltaT,two,splat(1.5f));
+        store(dt+g,deltaT);
+
+        Lanes k1x=dx*deltaT;
+        Lanes k1y=dy*deltaT;
+        Lanes k1z=dz*deltaT;
+        store(kx[0]+g,k1x);
+        store(ky[0]+g,k1y);
+        store(kz[0]+g,k1z);
+
+        store(sx+g,load(x+g)+k1x*half);
+        store(sy+g,load(y+g)+k1y*half);
+        store(sz+g,load(z+g)+k1z*half);
+    }
+
+    //k2 and k3, each sampled half a step ahead along the previous one
+    for(int k=1;k<3;++k)
+    {
+        sample(sx,sy,sz,vx,vy,vz);
+
+        for(int g=0;g<laneCount;g+=4)
+        {
+            Lanes deltaT=load(dt+g);
+
+            Lanes kxk=load(vx+g)*deltaT;
+            Lanes kyk=load(vy+g)*deltaT;
+            Lanes kzk=load(vz+g)*deltaT;
+            store(kx[k]+g,kxk);
+            store(ky[k]+g,kyk);
+            store(kz[k]+g,kzk);
+
+            //k3 is evaluated a full step ahead
+            Lanes f=k==1?half:splat(1.0f);
+
+            store(sx+g,load(x+g)+kxk*f);
+            store(sy+g,load(y+g)+kyk*f);
+            store(sz+g,load(z+g)+kzk*f);
+        }
+    }
+
+    sample(sx,sy,sz,vx,vy,vz);
+
+    Lanes sixth=splat(1.0f/6.0f);
+
+    for(int g=0;g<laneCount;g+=4)
+    {
+        Lanes deltaT=load(dt+g);
+
+        store(nx+g,load(x+g)+(load(kx[0]+g)+load(kx[1]+g)*two+load(kx[2]+g)*two+load(vx+g)*deltaT)*sixth);
+        store(ny+g,load(y+g)+(load(ky[0]+g)+load(ky[1]+g)*two+load(ky[2]+g)*two+load(vy+g)*deltaT)*sixth);
+        store(nz+g,load(z+g)+(load(kz[0]+g)+load(kz[1]+g)*two+load(kz[2]+g)*two+load(vz+g)*deltaT)*sixth);
+    }
+}
+
+bool PacketTracer::startLane(int lane,PacketTracer::SeedSource &source)
+{
+    int seed;
+
+    active[lane]=source.next(seed);
+
+    if(!active[lane])
+        return false;
+
+    const GGL::Point3f &start=seeds[seed];
+
+    laneSeed[lane]=seed;
+    laneSteps[lane]=0;
+    laneSamples[lane]=0;
+    laneFetches[lane]=0;
+
+    x[lane]=start.X();
+    y[lane]=start.Y();
+    z[lane]=start.Z();
+
+    //no cell yet, the first sample gathers one
+    cellX[lane]=cellY[lane]=cellZ[lane]=-2;
+
+    lanePoints[lane].clear();
+    laneEnd[lane]->restart();
+    lanePoints[lane].push_back(start);
+
+    return true;
+}
+
+void PacketTracer::run(PacketTracer::SeedSource &source,StreamlineStore &output,std::vector<int> &lineSeeds)
+{
+    int running=0;
+
+    for(int lane=0;lane<laneCount;++lane)
+        if(startLane(lane,source))
+            ++running;
+
+    float nx[laneCount];
+    float ny[laneCount];
+    float nz[laneCount];
+
+    while(running>0)
+    {
+        step(nx,ny,nz);
+
+        for(int lane=0;lane<laneCount;++lane)
+        {
+            if(!active[lane])
+                continue;
+
+            GGL::Point3f from(x[lane],y[lane],z[lane]);
+            GGL::Point3f to(nx[lane],ny[lane],nz[lane]);
+
+            ++laneSteps[lane];
+
+            //the same end test as StreamlineEnd
+            bool ended=(*laneEnd[lane])(from,to);
+
+            if(!ended)
+            {
+                field.prefetch(to,to-from);
+
+                x[lane]=to.X();
+                y[lane]=to.Y();
+                z[lane]=to.Z();
+                lanePoints[lane].push_back(to);
+            }
+
+            if(ended || laneSteps[lane]>=maxSteps)
+            {
+                std::vector<GGL::Point3f> &points=lanePoints[lane];
+
+                output.appendLine(&points[0],(int)points.size(),laneSamples[lane],laneFetches[lane]);
+                lineSeeds.push_back(laneSeed[lane]);
+
+                if(!startLane(lane,source))
+                    --running;
+            }
+        }
+    }
+}
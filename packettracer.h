@@ -0,0 +1,75 @@
+#ifndef PACKETTRACER_H
+#define PACKETTRACER_H
+
+#include <vector>
+#include "Point3.h"
+#include "streamlinestore.h"
+
+class VectorField;
+class EarlyTermination;
+
+//Advances laneCount RK4 streamlines in lockstep. Every stage samples all lanes at once, each lane
+//keeps the corners of its current cell as in CellSampler and the trilinear interpolation and the
+//RK arithmetic run across the lanes in SSE registers. A lane whose line ended is masked out and
+//refilled with the next seed right away, so the packet stays full until the seeds run out.
+//Lines are the same as Streamline::generate with ClassicRK4 on the same level.
+class PacketTracer
+{
+public:
+    enum {laneCount=8};
+
+    //hands out seed indices, false once there are none left
+    class SeedSource
+    {
+    public:
+        virtual ~SeedSource()
+        {};
+
+        virtual bool next(int &seed)=0;
+    };
+
+private:
+    const std::vector<GGL::Point3f> &seeds;
+    VectorField &field;
+    int level;
+
+    float maxX;
+    float maxY;
+    float maxZ;
+    float scale;
+    float offset;
+    int lastX;
+    int lastY;
+    int lastZ;
+
+    //lane state as structure of arrays, corners[k*3+c] holds component c of corner k per lane
+    float x[laneCount];
+    float y[laneCount];
+    float z[laneCount];
+    int cellX[laneCount];
+    int cellY[laneCount];
+    int cellZ[laneCount];
+    float corners[24][laneCount];
+
+    bool active[laneCount];
+    int laneSeed[laneCount];
+    int laneSteps[laneCount];
+    int laneSamples[laneCount];
+    int laneFetches[laneCount];
+    std::vector<GGL::Point3f> lanePoints[laneCount];
+    EarlyTermination *laneEnd[laneCount];
+
+    void sample(const float *sx,const float *sy,const float *sz,float *vx,float *vy,float *vz);
+    void step(float *nx,float *ny,float *nz);
+    bool startLane(int lane,SeedSource &source);
+
+public:
+    PacketTracer(const std::vector<GGL::Point3f> &_seeds,int _level=0);
+    ~PacketTracer();
+
+    //traces every seed the source hands out, lines are appended to output as they finish and
+    //lineSeeds gets the seed index of each
+    void run(SeedSource &source,StreamlineStore &output,std::vector<int> &lineSeeds);
+};
+
+#endif // PACKETTRACER_H
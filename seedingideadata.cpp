@@ -1,9 +1,12 @@
+#include <GL/glew.h>
 #include "seedingideadata.h"
 #include "VectorField.h"
 #include <map>
+#include <math.h>
+#include <string.h>
 #include <QtOpenGL/QGLWidget>
 
-SeedingIdeaData::SeedingIdeaData()
+SeedingIdeaData::SeedingIdeaData():boundaryVersion(0)
 {
   //  connect(&VectorField::getSingleton(),SIGNAL(dataUpdated()),this,SLOT(onVectorFieldLoaded()));
 }
@@ -19,28 +22,59 @@ void SeedingIdeaData::drawBoundary()
     {
         glDisable(GL_LIGHTING);
 
-        glBegin(GL_QUADS);
+        if(!boundaryBuffer.isCurrent(boundaryVersion))
+            uploadBoundary();
 
-        for(int i=0;i<vertexIndices.size();++i)
-        {
-            SVertex v=vertexList[vertexIndices[i]];
+        boundaryBuffer.bind();
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
 
-            if(v.inorout>0.5)
-                   glColor3ub(255.0*v.inorout,0,0);
-            else
-                   glColor3ub(0,0,255.0*-v.inorout);
-            glVertex3f(v.pos.X(),v.pos.Y(),v.pos.Z());
-        }
+        glVertexPointer(3,GL_FLOAT,0,bufferOffset(0));
+        glColorPointer(4,GL_UNSIGNED_BYTE,0,bufferOffset((int)(vertexList.size()*3*sizeof(float))));
 
-        glEnd();
+        glDrawElements(GL_QUADS,(GLsizei)vertexIndices.size(),GL_UNSIGNED_INT,bufferOffset(0));
 
+        glDisableClientState(GL_COLOR_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+        boundaryBuffer.unbind();
     }
 }
 
+void SeedingIdeaData::uploadBoundary()
+{
+    int vertexCount=(int)vertexList.size();
+    int positionBytes=vertexCount*3*(int)sizeof(float);
+
+    std::vector<unsigned char> data(positionBytes+vertexCount*4);
+
+    for(int i=0;i<vertexCount;++i)
+    {
+        const SVertex &v=vertexList[i];
+
+        memcpy(&data[i*3*sizeof(float)],v.pos.V(),3*sizeof(float));
+
+        //outflow in red, inflow in blue, as strong as the normalized flux
+        unsigned char *color=&data[positionBytes+i*4];
+
+        color[0]=v.inorout>0.5f?(unsigned char)qBound(0.0f,255.0f*v.inorout,255.0f):0;
+        color[1]=0;
+        color[2]=v.inorout>0.5f?0:(unsigned char)qBound(0.0f,-255.0f*v.inorout,255.0f);
+        color[3]=255;
+    }
+
+    boundaryBuffer.upload(boundaryVersion,&data[0],(int)data.size(),&vertexIndices[0],(int)(vertexIndices.size()*sizeof(unsigned int)));
+}
+
 void SeedingIdeaData::onVectorFieldLoaded()
 {
     std::map<unsigned int, unsigned int> uniqueVertices;
 
+    //+-(axis+1) of the inward face normal for every vertex, the tangents are sampled in one batch afterwards
+    std::vector<int> inwardAxes;
+
+    //a second "Generate Boundry" rebuilds the shell from scratch
+    vertexList.clear();
+    vertexIndices.clear();
     vertexList.reserve(1000);
 
     for(int x=0;x<VectorField::getSingleton().xSize-1;++x)
@@ -72,14 +106,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                 SVertex v;
                 v.pos.vec(x,y,0);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(x,y,0);
-
-                v.inorout=tangent.length();
-
-                if(tangent.Z()<0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(3);
 
             }
             else
@@ -93,14 +121,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                 SVertex v;
                 v.pos.vec(x+1,y,0);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(x+1,y,0);
-
-                v.inorout=tangent.length();
-
-                if(tangent.Z()<0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(3);
 
              //   qDebug("f");
             }
@@ -116,14 +138,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                  SVertex v;
                 v.pos.vec(x,y+1,0);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(x,y+1,0);
-
-                v.inorout=tangent.length();
-
-                if(tangent.Z()<0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(3);
             }
             else
             {
@@ -136,14 +152,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                  SVertex v;
                 v.pos.vec(x+1,y+1,0);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(x+1,y+1,0);
-
-                v.inorout=tangent.length();
-
-                if(tangent.Z()<0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(3);
             }
             else
             {
@@ -164,14 +174,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                  SVertex v;
                 v.pos.vec(x,y,VectorField::getSingleton().zSize-1);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(x,y,VectorField::getSingleton().zSize-1);
-
-                v.inorout=tangent.length();
-
-                if(tangent.Z()>0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(-3);
 
             }
             else
@@ -185,14 +189,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                  SVertex v;
                 v.pos.vec(x+1,y,VectorField::getSingleton().zSize-1);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(x+1,y,VectorField::getSingleton().zSize-1);
-
-                v.inorout=tangent.length();
-
-                if(tangent.Z()>0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(-3);
             }
             else
             {
@@ -206,14 +204,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                  SVertex v;
                 v.pos.vec(x,y+1,VectorField::getSingleton().zSize-1);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(x,y+1,VectorField::getSingleton().zSize-1);
-
-                v.inorout=tangent.length();
-
-                if(tangent.Z()>0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(-3);
             }
             else
             {
@@ -226,14 +218,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                  SVertex v;
                 v.pos.vec(x+1,y+1,VectorField::getSingleton().zSize-1);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(x+1,y+1,VectorField::getSingleton().zSize-1);
-
-                v.inorout=tangent.length();
-
-                if(tangent.Z()>0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(-3);
             }
             else
             {
@@ -288,14 +274,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                  SVertex v;
                 v.pos.vec(0,y,z);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(0,y,z);
-
-                v.inorout=tangent.length();
-
-                if(tangent.X()<0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(1);
 
             }
             else
@@ -309,14 +289,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                  SVertex v;
                 v.pos.vec(0,y+1,z);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(0,y+1,z);
-
-                v.inorout=tangent.length();
-
-                if(tangent.X()<0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(1);
             }
             else
             {
@@ -330,14 +304,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                  SVertex v;
                 v.pos.vec(0,y,z+1);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(0,y,z+1);
-
-                v.inorout=tangent.length();
-
-                if(tangent.X()<0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(1);
             }
             else
             {
@@ -350,14 +318,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                  SVertex v;
                 v.pos.vec(0,y+1,z+1);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(0,y+1,z+1);
-
-                v.inorout=tangent.length();
-
-                if(tangent.X()<0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(1);
             }
             else
             {
@@ -378,14 +340,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                  SVertex v;
                 v.pos.vec(VectorField::getSingleton().xSize-1,y,z);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(VectorField::getSingleton().xSize-1,y,z);
-
-                v.inorout=tangent.length();
-
-                if(tangent.X()>0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(-1);
 
             }
             else
@@ -399,14 +355,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                  SVertex v;
                 v.pos.vec(VectorField::getSingleton().xSize-1,y+1,z);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(VectorField::getSingleton().xSize-1,y+1,z);
-
-                v.inorout=tangent.length();
-
-                if(tangent.X()>0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(-1);
             }
             else
             {
@@ -420,14 +370,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                  SVertex v;
                 v.pos.vec(VectorField::getSingleton().xSize-1,y,z+1);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(VectorField::getSingleton().xSize-1,y,z+1);
-
-                v.inorout=tangent.length();
-
-                if(tangent.X()>0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(-1);
             }
             else
             {
@@ -440,14 +384,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                  SVertex v;
                 v.pos.vec(VectorField::getSingleton().xSize-1,y+1,z+1);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(VectorField::getSingleton().xSize-1,y+1,z+1);
-
-                v.inorout=tangent.length();
-
-                if(tangent.X()>0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(-1);
             }
             else
             {
@@ -495,14 +433,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                 struct SVertex v;
                 v.pos.vec(x,0,z);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(x,0,z);
-
-                v.inorout=tangent.length();
-
-                if(tangent.Y()<0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(2);
 
             }
             else
@@ -516,14 +448,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                 struct SVertex v;
                 v.pos.vec(x+1,0,z);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(x+1,0,z);
-
-                v.inorout=tangent.length();
-
-                if(tangent.Y()<0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(2);
             }
             else
             {
@@ -537,14 +463,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                 struct SVertex v;
                 v.pos.vec(x,0,z+1);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(x,0,z+1);
-
-                v.inorout=tangent.length();
-
-                if(tangent.Y()<0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(2);
             }
             else
             {
@@ -557,14 +477,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                 struct SVertex v;
                 v.pos.vec(x+1,0,z+1);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(x+1,0,z+1);
-
-                v.inorout=tangent.length();
-
-                if(tangent.Y()<0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(2);
             }
             else
             {
@@ -585,14 +499,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                 struct SVertex v;
                 v.pos.vec(x,VectorField::getSingleton().ySize-1,z);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(x,VectorField::getSingleton().ySize-1,z);
-
-                v.inorout=tangent.length();
-
-                if(tangent.Y()>0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(-2);
 
             }
             else
@@ -606,14 +514,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                 struct SVertex v;
                 v.pos.vec(x+1,VectorField::getSingleton().ySize-1,z);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(x+1,VectorField::getSingleton().ySize-1,z);
-
-                v.inorout=tangent.length();
-
-                if(tangent.Y()>0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(-2);
             }
             else
             {
@@ -627,14 +529,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                 struct SVertex v;
                 v.pos.vec(x,VectorField::getSingleton().ySize-1,z+1);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(x,VectorField::getSingleton().ySize-1,z+1);
-
-                v.inorout=tangent.length();
-
-                if(tangent.Y()>0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(-2);
             }
             else
             {
@@ -647,14 +543,8 @@ void SeedingIdeaData::onVectorFieldLoaded()
                 struct SVertex v;
                 v.pos.vec(x+1,VectorField::getSingleton().ySize-1,z+1);
 
-                GGL::Point3f tangent=VectorField::getSingleton().getVector(x+1,VectorField::getSingleton().ySize-1,z+1);
-
-                v.inorout=tangent.length();
-
-                if(tangent.Y()>0)
-                    v.inorout=-v.inorout;
-
                 vertexList.push_back(v);
+                inwardAxes.push_back(-2);
             }
             else
             {
@@ -669,6 +559,35 @@ void SeedingIdeaData::onVectorFieldLoaded()
         }
 
 
+    int vertexCount=(int)inwardAxes.size();
+
+    std::vector<float> px(vertexCount),py(vertexCount),pz(vertexCount);
+    std::vector<float> tangents[3];
+
+    for(int c=0;c<3;++c)
+        tangents[c].resize(vertexCount);
+
+    for(int i=0;i<vertexCount;++i)
+    {
+        px[i]=vertexList[i].pos.X();
+        py[i]=vertexList[i].pos.Y();
+        pz[i]=vertexList[i].pos.Z();
+    }
+
+    if(vertexCount)
+        VectorField::getSingleton().getVectors(vertexCount,&px[0],&py[0],&pz[0],&tangents[0][0],&tangents[1][0],&tangents[2][0]);
+
+    for(int i=0;i<vertexCount;++i)
+    {
+        int axis=abs(inwardAxes[i])-1;
+        float inward=inwardAxes[i]>0?tangents[axis][i]:-tangents[axis][i];
+
+        vertexList[i].inorout=sqrt(tangents[0][i]*tangents[0][i]+tangents[1][i]*tangents[1][i]+tangents[2][i]*tangents[2][i]);
+
+        if(inward<0)
+            vertexList[i].inorout=-vertexList[i].inorout;
+    }
+
 float largestP=0;
 float largestN=0;
 
@@ -699,6 +618,8 @@ float largestN=0;
         qDebug("df");
     }
 
+    ++boundaryVersion;
+
 
 
 
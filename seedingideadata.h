@@ -4,6 +4,7 @@
 #include <QObject>
 #include <vector>
 #include "Point3.h"
+#include "vertexbuffer.h"
 
 class SVertex
 {
@@ -33,6 +34,12 @@ private:
     std::vector<SVertex> vertexList;
     std::vector<unsigned int> vertexIndices;
 
+    //the boundary quads on the GPU, positions then RGBA colors, re-uploaded when the version moves on
+    VertexBuffer boundaryBuffer;
+    unsigned int boundaryVersion;
+
+    void uploadBoundary();
+
     SeedingIdeaData();
 
 public:
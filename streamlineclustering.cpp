@@ -0,0 +1,352 @@
+#include "streamlineclustering.h"
+#include "StreamLine.h"
+#include "streamlinetracer.h"
+#include "streamlineresampler.h"
+#include "VectorField.h"
+#include "MTRand.h"
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+#include <QtCore/QTime>
+#include <QtCore/QVector>
+#include <QtCore/QtConcurrentMap>
+//last, it defines min and max as macros
+#include "cluster.h"
+
+//lines are kept as sampleCount x, then y, then z values so the distance loops run over plain arrays
+enum {lineStride=3*StreamlineClustering::sampleCount};
+
+//mean closest point distance, both ways round so it is symmetric
+float StreamlineClustering::lineDistance(const float *a,const float *b)
+{
+    float columnMin[sampleCount];
+    float sum=0.0f;
+
+    for(int j=0;j<sampleCount;++j)
+        columnMin[j]=FLT_MAX;
+
+    for(int i=0;i<sampleCount;++i)
+    {
+        float ax=a[i];
+        float ay=a[i+sampleCount];
+        float az=a[i+2*sampleCount];
+        float rowMin=FLT_MAX;
+
+        for(int j=0;j<sampleCount;++j)
+        {
+            float dx=b[j]-ax;
+            float dy=b[j+sampleCount]-ay;
+            float dz=b[j+2*sampleCount]-az;
+            float d=dx*dx+dy*dy+dz*dz;
+
+            rowMin=qMin(rowMin,d);
+            columnMin[j]=qMin(columnMin[j],d);
+        }
+
+        sum+=sqrt(rowMin);
+    }
+
+    for(int j=0;j<sampleCount;++j)
+        sum+=sqrt(columnMin[j]);
+
+    return sum/(2.0f*sampleCount);
+}
+
+void StreamlineClustering::computeDistanceRow(DistanceRow &row)
+{
+    const float *line=row.samples+row.row*lineStride;
+
+    for(int j=0;j<row.row;++j)
+        row.distances[j]=lineDistance(line,row.samples+j*lineStride);
+}
+
+//Shannon entropy of the segment directions over 24 bins, a cube face and a quadrant of it. A
+//straight line has none, a line that turns through many directions has the most.
+float StreamlineClustering::directionEntropy(const float *line)
+{
+    enum {binCount=24};
+
+    int bins[binCount];
+    int total=0;
+
+    for(int i=0;i<binCount;++i)
+        bins[i]=0;
+
+    for(int i=0;i+1<sampleCount;++i)
+    {
+        float d[3];
+
+        for(int c=0;c<3;++c)
+            d[c]=line[i+1+c*sampleCount]-line[i+c*sampleCount];
+
+        int axis=fabs(d[0])>=fabs(d[1])?(fabs(d[0])>=fabs(d[2])?0:2):(fabs(d[1])>=fabs(d[2])?1:2);
+
+        if(d[axis]==0.0f)
+            continue;
+
+        int face=axis*2+(d[axis]<0.0f?1:0);
+        int quadrant=(d[(axis+1)%3]<0.0f?1:0)+(d[(axis+2)%3]<0.0f?2:0);
+
+        ++bins[face*4+quadrant];
+        ++total;
+    }
+
+    float entropy=0.0f;
+
+    for(int i=0;i<binCount;++i)
+    {
+        if(bins[i]==0)
+            continue;
+
+        float p=(float)bins[i]/(float)total;
+        entropy-=p*log(p);
+    }
+
+    return entropy/log(2.0f);
+}
+
+struct ClusterOrder
+{
+    const std::vector< std::vector<int> > *members;
+
+    bool operator()(int a,int b) const
+    {
+        if((*members)[a].size()!=(*members)[b].size())
+            return (*members)[a].size()>(*members)[b].size();
+
+        return (*members)[a][0]<(*members)[b][0];
+    };
+};
+
+static void freeDistances(double **distances,int lineCount)
+{
+    for(int i=0;i<lineCount;++i)
+        delete [] distances[i];
+
+    delete [] distances;
+}
+
+ClusterResult StreamlineClustering::cluster(const StreamlineStore &lines,int clusterCount)
+{
+    ClusterResult result;
+
+    QTime timer;
+    timer.start();
+
+    //all lines on all cores, then the ones that could be resampled are split into x, y and z
+    StreamlineResampler resampler(StreamlineResampler::UniformCount,sampleCount);
+    StreamlineStore resampledLines;
+    std::vector<char> resampled;
+
+    resampler.resample(lines,resampledLines,true,&resampled);
+
+    std::vector<float> samples;
+    samples.reserve((size_t)lines.getLineCount()*lineStride);
+
+    for(int i=0;i<resampledLines.getLineCount();++i)
+    {
+        if(!resampled[i])
+            continue;
+
+        const GGL::Point3f *line=resampledLines.getLine(i);
+
+        for(int c=0;c<3;++c)
+            for(int k=0;k<sampleCount;++k)
+                samples.push_back(line[k][c]);
+    }
+
+    int lineCount=(int)(samples.size()/lineStride);
+
+    if(lineCount==0)
+        return result;
+
+    clusterCount=qBound(1,clusterCount,lineCount);
+
+    int resampleTime=timer.restart();
+
+    //the lower triangle only, row i holds the distances to lines 0..i-1
+    double **distances=new double*[lineCount];
+    QVector<DistanceRow> rows(lineCount);
+
+    for(int i=0;i<lineCount;++i)
+    {
+        distances[i]=i?new double[i]:NULL;
+
+        rows[i].samples=&samples[0];
+        rows[i].row=i;
+        rows[i].distances=distances[i];
+    }
+
+    QtConcurrent::blockingMap(rows,&StreamlineClustering::computeDistanceRow);
+
+    int distanceTime=timer.restart();
+
+    //Deterministic start for k-medoids: the most central line, then each time the line farthest
+    //from the medoids picked so far. Random restarts would give other bundles on every run.
+    std::vector<double> sums(lineCount,0.0);
+
+    for(int i=1;i<lineCount;++i)
+        for(int j=0;j<i;++j)
+        {
+            sums[i]+=distances[i][j];
+            sums[j]+=distances[i][j];
+        }
+
+    std::vector<int> clusterid(lineCount,0);
+    std::vector<double> nearest(lineCount,DBL_MAX);
+    int medoid=(int)(std::min_element(sums.begin(),sums.end())-sums.begin());
+
+    for(int c=0;c<clusterCount;++c)
+    {
+        int farthest=0;
+
+        for(int i=0;i<lineCount;++i)
+        {
+            double d=i==medoid?0.0:(i>medoid?distances[i][medoid]:distances[medoid][i]);
+
+            if(d<nearest[i])
+            {
+                nearest[i]=d;
+                clusterid[i]=c;
+            }
+
+            if(nearest[i]>nearest[farthest])
+                farthest=i;
+        }
+
+        //every line coincides with a medoid already, a further seed would start an empty cluster
+        //and cluster.cpp cannot take one
+        if(c+1<clusterCount && nearest[farthest]==0.0)
+        {
+            clusterCount=c+1;
+            break;
+        }
+
+        medoid=farthest;
+    }
+
+    double error=0.0;
+    int found=0;
+
+    kmedoids(clusterCount,lineCount,distances,0,&clusterid[0],&error,&found);
+
+    int clusterTime=timer.restart();
+
+    //found is 0 for arguments kmedoids refused and -1 when it ran out of memory, clusterid is not
+    //a valid assignment then
+    if(found<=0)
+    {
+        freeDistances(distances,lineCount);
+        qDebug("k-medoids failed (%d) clustering %d lines into %d bundles",found,lineCount,clusterCount);
+        return result;
+    }
+
+    //clusterid now holds the medoid line of each line
+    std::vector< std::vector<int> > members;
+    std::vector<int> clusterOf(lineCount,-1);
+
+    for(int i=0;i<lineCount;++i)
+    {
+        int m=clusterid[i];
+
+        if(clusterOf[m]<0)
+        {
+            clusterOf[m]=(int)members.size();
+            members.push_back(std::vector<int>(1,m));
+        }
+
+        if(i!=m)
+            members[clusterOf[m]].push_back(i);
+    }
+
+    //largest bundles first
+    std::vector<int> order(members.size());
+
+    for(size_t i=0;i<order.size();++i)
+        order[i]=(int)i;
+
+    ClusterOrder byDescendingSize;
+    byDescendingSize.members=&members;
+    std::sort(order.begin(),order.end(),byDescendingSize);
+
+    for(size_t c=0;c<order.size();++c)
+    {
+        const std::vector<int> &lineIds=members[order[c]];
+        std::vector<StreamSampleLine> aCluster(lineIds.size());
+
+        int largest=0;
+        int smallest=0;
+        float largestEntropy=-1.0f;
+        float smallestEntropy=FLT_MAX;
+        double spread=0.0;
+
+        for(size_t e=0;e<lineIds.size();++e)
+        {
+            const float *line=&samples[(size_t)lineIds[e]*lineStride];
+
+            aCluster[e].samples.resize(sampleCount);
+
+            for(int k=0;k<sampleCount;++k)
+                aCluster[e].samples[k]=GGL::Point3f(line[k],line[k+sampleCount],line[k+2*sampleCount]);
+
+            float entropy=directionEntropy(line);
+
+            if(entropy>largestEntropy)
+            {
+                largestEntropy=entropy;
+                largest=(int)e;
+            }
+
+            if(entropy<smallestEntropy)
+            {
+                smallestEntropy=entropy;
+                smallest=(int)e;
+            }
+
+            int a=lineIds[e];
+            int m=lineIds[0];
+
+            if(a!=m)
+                spread+=a>m?distances[a][m]:distances[m][a];
+        }
+
+        result.clusterlist.push_back(aCluster);
+        result.largestEntropy.push_back(largest);
+        result.smallestEntropy.push_back(smallest);
+        result.variations.push_back((float)(spread/lineIds.size()));
+    }
+
+    freeDistances(distances,lineCount);
+
+    qDebug("Clustered %d lines into %d bundles: resample %d ms, distances %d ms, k-medoids %d ms",lineCount,(int)result.clusterlist.size(),resampleTime,distanceTime,clusterTime);
+
+    return result;
+}
+
+ClusterResult StreamlineClustering::traceAndCluster(int seedCount,int clusterCount)
+{
+    VectorField &field=VectorField::getSingleton();
+
+    //a private generator with a fixed seed, the same field and settings give the same bundles every
+    //time and the rand() of the GUI thread is left alone. Seeds lie on the grid of randomSeed.
+    MTRand random(23);
+    std::vector<GGL::Point3f> seeds(seedCount);
+
+    for(int i=0;i<seedCount;++i)
+    {
+        float x=(float)random.randInt(6399)/6400.0f*(field.xSize-1);
+        float y=(float)random.randInt(6399)/6400.0f*(field.ySize-1);
+        float z=(float)random.randInt(6399)/6400.0f*(field.zSize-1);
+
+        seeds[i]=GGL::Point3f(x,y,z);
+    }
+
+    StreamlineStore lines;
+    StreamlineTracer tracer;
+    tracer.trace(seeds,lines);
+
+    //clustering only needs the lines
+    field.endBackgroundRead();
+
+    return cluster(lines,clusterCount);
+}
@@ -0,0 +1,43 @@
+#ifndef STREAMLINECLUSTERING_H
+#define STREAMLINECLUSTERING_H
+
+#include <vector>
+#include "Point3.h"
+#include "streamlinestore.h"
+#include "clusterresultfile.h"
+
+//Groups traced lines into bundles for the illustrative tapes, the in-app replacement for the
+//cluster-*.dat files. Every line is resampled to sampleCount points at equal arc length, lines are
+//compared by their mean closest point distance and split with k-medoids from cluster.cpp. In the
+//result the medoid is the first line of each cluster, as drawn by "Draw Center".
+class StreamlineClustering
+{
+    //one row of the ragged distance matrix of cluster.cpp, distances from line row to every line before it
+    struct DistanceRow
+    {
+        const float *samples;
+        int row;
+        double *distances;
+    };
+
+    static void computeDistanceRow(DistanceRow &row);
+
+    static float lineDistance(const float *a,const float *b);
+
+    static float directionEntropy(const float *line);
+
+public:
+    //computeSections and the tape builders assume 49 samples a line
+    enum {sampleCount=49};
+
+    //lines that cannot be resampled are left out, with fewer distinct lines than clusters there are
+    //fewer clusters
+    static ClusterResult cluster(const StreamlineStore &lines,int clusterCount);
+
+    //Traces seedCount lines from random seeds in the loaded field and clusters them, can run on any
+    //thread. The caller calls VectorField::beginBackgroundRead first, the read is ended here as soon
+    //as the lines are traced so a load waits only for the tracing.
+    static ClusterResult traceAndCluster(int seedCount,int clusterCount);
+};
+
+#endif // STREAMLINECLUSTERING_H
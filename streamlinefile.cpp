@@ -0,0 +1,429 @@
+#include "streamlinefile.h"
+#include <limits.h>
+#include <string.h>
+#include <math.h>
+
+static void putVarint(std::vector<char> &out,unsigned int v)
+{
+    while(v>=0x80)
+    {
+        out.push_back((char)(v|0x80));
+        v>>=7;
+    }
+
+    out.push_back((char)v);
+}
+
+//false when the varint runs past end
+static bool getVarint(const uchar *&p,const uchar *end,unsigned int &v)
+{
+    v=0;
+
+    for(int shift=0;shift<35;shift+=7)
+    {
+        if(p>=end)
+            return false;
+
+        uchar b=*p++;
+        v|=(unsigned int)(b&0x7f)<<shift;
+
+        if(!(b&0x80))
+            return true;
+    }
+
+    return false;
+}
+
+static inline unsigned int zigzag(int v)
+{
+    return ((unsigned int)v<<1)^(unsigned int)(v>>31);
+}
+
+static inline int unzigzag(unsigned int v)
+{
+    return (int)(v>>1)^-(int)(v&1);
+}
+
+StreamlineWriter::StreamlineWriter():inLine(false),failed(false),position(0)
+{
+    memset(&header,0,sizeof(header));
+}
+
+StreamlineWriter::~StreamlineWriter()
+{
+    if(file.isOpen())
+        close();
+}
+
+bool StreamlineWriter::open(const QString &filename,StreamlineFile::Encoding encoding,int attributes,float quantum)
+{
+    if(file.isOpen())
+        close();
+
+    file.setFileName(filename);
+
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    memset(&header,0,sizeof(header));
+    memcpy(header.magic,"SLF1",4);
+    header.version=streamlineFileVersion;
+    header.byteOrder=streamlineFileByteOrder;
+    header.encoding=encoding;
+    header.attributes=attributes&((1<<StreamlineFile::attributeBits)-1);
+    header.quantum=quantum>0.0f?quantum:1.0f/1024.0f;
+
+    offsets.clear();
+    counts.clear();
+    inLine=false;
+
+    //the final header goes over this one on close
+    failed=file.write((const char *)&header,sizeof(header))!=(qint64)sizeof(header);
+    position=sizeof(header);
+
+    return !failed;
+}
+
+void StreamlineWriter::writeLine(const GGL::Point3f *points,int count)
+{
+    if(inLine)
+        flushLine();
+
+    record.clear();
+
+    if(header.encoding==StreamlineFile::Float32)
+    {
+        record.resize(count*3*sizeof(float));
+
+        if(count)
+            memcpy(&record[0],points,record.size());
+    }
+    else
+    {
+        double scale=1.0/header.quantum;
+        int last[3]={0,0,0};
+
+        //deltas of the rounded coordinates, so the error never adds up along the line
+        for(int i=0;i<count;++i)
+            for(int c=0;c<3;++c)
+            {
+                int q=(int)floor(points[i][c]*scale+0.5);
+                putVarint(record,zigzag(q-last[c]));
+                last[c]=q;
+            }
+    }
+
+    for(int bit=0;bit<StreamlineFile::attributeBits;++bit)
+        attributeCounts[bit]=0;
+
+    counts.push_back(count);
+    header.pointCount+=count;
+    inLine=true;
+}
+
+void StreamlineWriter::writeAttribute(int attribute,const float *values,int count)
+{
+    if(!inLine || !(header.attributes&attribute))
+        return;
+
+    int bit=0;
+
+    while((1<<bit)!=attribute)
+        ++bit;
+
+    int floats=count*StreamlineFile::components(attribute);
+
+    attributeValues[bit].assign(values,values+floats);
+    attributeCounts[bit]=count;
+}
+
+void StreamlineWriter::flushLine()
+{
+    for(int bit=0;bit<StreamlineFile::attributeBits;++bit)
+    {
+        if(!(header.attributes&(1<<bit)))
+            continue;
+
+        int count=attributeCounts[bit];
+        size_t bytes=count*StreamlineFile::components(1<<bit)*sizeof(float);
+        size_t at=record.size();
+
+        record.resize(at+sizeof(int)+bytes);
+        memcpy(&record[at],&count,sizeof(int));
+
+        if(bytes)
+            memcpy(&record[at+sizeof(int)],&attributeValues[bit][0],bytes);
+    }
+
+    offsets.push_back(position);
+
+    if(!record.empty() && !failed)
+        failed=file.write(&record[0],record.size())!=(qint64)record.size();
+
+    position+=record.size();
+    inLine=false;
+}
+
+bool StreamlineWriter::close()
+{
+    if(!file.isOpen())
+        return false;
+
+    if(inLine)
+        flushLine();
+
+    offsets.push_back(position);
+
+    //the table is 8 byte aligned so a mapping can read it in place
+    qint64 padding=(8-position%8)%8;
+    char zeros[8]={0,0,0,0,0,0,0,0};
+
+    if(!failed && padding)
+        failed=file.write(zeros,padding)!=padding;
+
+    header.lineCount=(int)counts.size();
+    header.tableOffset=position+padding;
+    header.countOffset=header.tableOffset+(qint64)offsets.size()*sizeof(qint64);
+
+    if(!failed)
+        failed=file.write((const char *)&offsets[0],offsets.size()*sizeof(qint64))!=(qint64)(offsets.size()*sizeof(qint64));
+
+    if(!failed && !counts.empty())
+        failed=file.write((const char *)&counts[0],counts.size()*sizeof(int))!=(qint64)(counts.size()*sizeof(int));
+
+    if(!failed)
+        failed=!file.seek(0) || file.write((const char *)&header,sizeof(header))!=(qint64)sizeof(header);
+
+    file.close();
+
+    if(failed)
+        QFile::remove(file.fileName());
+
+    offsets.clear();
+    counts.clear();
+
+    return !failed;
+}
+
+StreamlineReader::StreamlineReader():mapped(NULL),fileBytes(0),offsets(NULL),counts(NULL)
+{
+    memset(&header,0,sizeof(header));
+}
+
+StreamlineReader::~StreamlineReader()
+{
+    close();
+}
+
+bool StreamlineReader::open(const QString &filename)
+{
+    close();
+
+    file.setFileName(filename);
+
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    fileBytes=file.size();
+
+    if(fileBytes<(qint64)sizeof(header) || !(mapped=file.map(0,fileBytes)))
+    {
+        close();
+        return false;
+    }
+
+    memcpy(&header,mapped,sizeof(header));
+
+    //a file from a machine of the other byte order would need converting, it is refused instead
+    bool valid=memcmp(header.magic,"SLF1",4)==0 && header.version==streamlineFileVersion
+            && header.byteOrder==streamlineFileByteOrder
+            && (header.encoding==StreamlineFile::Float32 || header.encoding==StreamlineFile::QuantizedDelta)
+            && header.lineCount>=0 && header.quantum>0.0f && header.tableOffset%8==0
+            && header.tableOffset>=(qint64)sizeof(header)
+            //a point takes at least a byte per coordinate, so a larger count can only be corrupt, and
+            //a store indexes its points with an int
+            && header.pointCount>=0 && header.pointCount<=(header.tableOffset-(qint64)sizeof(header))/3
+            && header.pointCount<=INT_MAX
+            && header.countOffset==header.tableOffset+(qint64)(header.lineCount+1)*sizeof(qint64)
+            && header.countOffset+(qint64)header.lineCount*sizeof(int)<=fileBytes;
+
+    if(!valid)
+    {
+        close();
+        return false;
+    }
+
+    offsets=(const qint64 *)(mapped+header.tableOffset);
+    counts=(const int *)(mapped+header.countOffset);
+
+    return true;
+}
+
+void StreamlineReader::close()
+{
+    if(mapped)
+        file.unmap(mapped);
+
+    file.close();
+
+    mapped=NULL;
+    offsets=NULL;
+    counts=NULL;
+    fileBytes=0;
+    memset(&header,0,sizeof(header));
+}
+
+bool StreamlineReader::readLine(int line,std::vector<GGL::Point3f> &points) const
+{
+    if(!mapped || line<0 || line>=header.lineCount)
+        return false;
+
+    qint64 begin=offsets[line];
+    qint64 end=offsets[line+1];
+    int count=counts[line];
+
+    if(begin<(qint64)sizeof(header) || begin>end || end>header.tableOffset || count<0)
+        return false;
+
+    const uchar *p=mapped+begin;
+    size_t first=points.size();
+
+    if(header.encoding==StreamlineFile::Float32)
+    {
+        if((qint64)count*3*sizeof(float)>end-begin)
+            return false;
+
+        points.resize(first+count);
+
+        if(count)
+            memcpy(&points[first],p,count*3*sizeof(float));
+
+        return true;
+    }
+
+    //every coordinate is at least one varint byte, a larger count must not size the reserve
+    if((qint64)count*3>end-begin)
+        return false;
+
+    const uchar *stop=mapped+end;
+    int last[3]={0,0,0};
+
+    points.reserve(first+count);
+
+    for(int i=0;i<count;++i)
+    {
+        GGL::Point3f point;
+
+        for(int c=0;c<3;++c)
+        {
+            unsigned int v;
+
+            if(!getVarint(p,stop,v))
+            {
+                points.resize(first);
+                return false;
+            }
+
+            last[c]+=unzigzag(v);
+            point[c]=last[c]*header.quantum;
+        }
+
+        points.push_back(point);
+    }
+
+    return true;
+}
+
+const uchar *StreamlineReader::attributeStart(int line,int attribute,int &count) const
+{
+    if(!mapped || line<0 || line>=header.lineCount || !(header.attributes&attribute))
+        return NULL;
+
+    qint64 begin=offsets[line];
+    qint64 end=offsets[line+1];
+
+    if(begin<(qint64)sizeof(header) || begin>end || end>header.tableOffset || counts[line]<0)
+        return NULL;
+
+    const uchar *p=mapped+begin;
+    const uchar *stop=mapped+end;
+
+    //skip the points, varints end at a byte without the high bit
+    if(header.encoding==StreamlineFile::Float32)
+        p+=(qint64)counts[line]*3*sizeof(float);
+    else
+        for(int i=counts[line]*3;i>0 && p<stop;++p)
+            if(!(*p&0x80))
+                --i;
+
+    for(int bit=0;bit<StreamlineFile::attributeBits;++bit)
+    {
+        if(!(header.attributes&(1<<bit)))
+            continue;
+
+        if(p+sizeof(int)>stop)
+            return NULL;
+
+        memcpy(&count,p,sizeof(int));
+        p+=sizeof(int);
+
+        qint64 bytes=(qint64)count*StreamlineFile::components(1<<bit)*sizeof(float);
+
+        if(count<0 || p+bytes>stop)
+            return NULL;
+
+        if((1<<bit)==attribute)
+            return p;
+
+        p+=bytes;
+    }
+
+    return NULL;
+}
+
+bool StreamlineReader::readAttribute(int line,int attribute,std::vector<float> &values) const
+{
+    int count=0;
+    const uchar *p=attributeStart(line,attribute,count);
+
+    if(!p)
+        return false;
+
+    size_t first=values.size();
+    int floats=count*StreamlineFile::components(attribute);
+
+    values.resize(first+floats);
+
+    //records are not aligned, so copy rather than cast
+    if(floats)
+        memcpy(&values[first],p,floats*sizeof(float));
+
+    return true;
+}
+
+bool StreamlineReader::readAll(StreamlineStore &store) const
+{
+    if(!mapped)
+        return false;
+
+    //the lines are decoded into a store of their own and merged once all of them read, a damaged
+    //record leaves the caller's store as it was
+    StreamlineStore loaded;
+    loaded.reserve(header.lineCount,(int)header.pointCount);
+
+    std::vector<GGL::Point3f> points;
+
+    for(int line=0;line<header.lineCount;++line)
+    {
+        points.clear();
+
+        if(!readLine(line,points))
+            return false;
+
+        loaded.appendLine(points.empty()?NULL:&points[0],(int)points.size(),0,0);
+    }
+
+    store.append(loaded);
+
+    return true;
+}
@@ -0,0 +1,138 @@
+#ifndef STREAMLINEFILE_H
+#define STREAMLINEFILE_H
+
+#include <vector>
+#include <QtCore/QFile>
+#include <QtCore/QString>
+#include "Point3.h"
+#include "streamlinestore.h"
+
+//Header of a .slf streamline file. Line records follow the header back to back in the order they
+//were written, the offset table and the point counts come after the last record so the writer
+//never has to hold more than one line. Offsets are from the start of the file.
+struct StreamlineFileHeader
+{
+    char magic[4];
+    int version;
+    int byteOrder;
+
+    int encoding;
+    int attributes;
+    int lineCount;
+    qint64 pointCount;
+
+    //grid spacing of QuantizedDelta coordinates in voxels
+    float quantum;
+    int reserved[3];
+
+    //lineCount+1 qint64 record offsets, the last one is the end of the payload
+    qint64 tableOffset;
+    //lineCount int point counts
+    qint64 countOffset;
+};
+
+enum {streamlineFileVersion=1, streamlineFileByteOrder=0x01020304};
+
+//Per line record: the points, then for every attribute bit set in the header from the lowest up an
+//int value count followed by count*components floats. An attribute is usually one value per
+//point, tape curvature and torsion have one per cross section.
+class StreamlineFile
+{
+public:
+    enum Encoding {Float32=0, QuantizedDelta=1};
+
+    //Float32 is 12 bytes a point. QuantizedDelta rounds to a grid of quantum voxels and stores the
+    //difference to the previous point as zigzag varints, 3 to 6 bytes a point for the usual steps
+    //with the position error bounded by quantum/2 and no drift along the line.
+    enum Attribute {Curvature=1, Torsion=2, Magnitude=4, Normal=8, attributeBits=4};
+
+    static int components(int attribute)
+    {
+        return attribute==Normal?3:1;
+    };
+};
+
+class StreamlineWriter
+{
+    QFile file;
+    StreamlineFileHeader header;
+
+    //the line being assembled, it goes out when the next line starts or on close
+    std::vector<char> record;
+    std::vector<float> attributeValues[StreamlineFile::attributeBits];
+    int attributeCounts[StreamlineFile::attributeBits];
+    bool inLine;
+    bool failed;
+    qint64 position;
+
+    std::vector<qint64> offsets;
+    std::vector<int> counts;
+
+    void flushLine();
+
+public:
+    StreamlineWriter();
+    ~StreamlineWriter();
+
+    bool open(const QString &filename,StreamlineFile::Encoding encoding=StreamlineFile::QuantizedDelta,int attributes=0,float quantum=1.0f/1024.0f);
+
+    void writeLine(const GGL::Point3f *points,int count);
+
+    //after writeLine, once for each attribute given to open, in any order, an attribute left out
+    //is stored with no values. values holds count*components floats.
+    void writeAttribute(int attribute,const float *values,int count);
+
+    //writes the tables and the header, false if anything failed and the file is removed then
+    bool close();
+};
+
+//Maps a .slf file and decodes lines on demand, nothing is read up front but the header.
+class StreamlineReader
+{
+    QFile file;
+    uchar *mapped;
+    qint64 fileBytes;
+    StreamlineFileHeader header;
+
+    const qint64 *offsets;
+    const int *counts;
+
+    const uchar *attributeStart(int line,int attribute,int &count) const;
+
+public:
+    StreamlineReader();
+    ~StreamlineReader();
+
+    //false when the file is not one this build can map or its tables do not fit the file
+    bool open(const QString &filename);
+    void close();
+
+    int getLineCount() const
+    {
+        return mapped?header.lineCount:0;
+    };
+
+    qint64 getPointCount() const
+    {
+        return mapped?header.pointCount:0;
+    };
+
+    int getAttributes() const
+    {
+        return mapped?header.attributes:0;
+    };
+
+    int getLineSize(int line) const
+    {
+        return counts[line];
+    };
+
+    //append to the output, false on a damaged record
+    bool readLine(int line,std::vector<GGL::Point3f> &points) const;
+    bool readAttribute(int line,int attribute,std::vector<float> &values) const;
+
+    //every line, with no sample or fetch counts, nothing is appended when a record is damaged
+    bool readAll(StreamlineStore &store) const;
+};
+
+#endif // STREAMLINEFILE_H
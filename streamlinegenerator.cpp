@@ -1,5 +1,15 @@
 #include "streamlinegenerator.h"
 #include "StreamLine.h"
+#include "VectorField.h"
+#include "streamlinetracer.h"
+#include "evenlyspacedseeder.h"
+#include "unsteadytracer.h"
+#include "streamlinefile.h"
+#include "streamlineresampler.h"
+#include <QtCore/QTime>
+#include <QtCore/QFileInfo>
+#include <QtGui/QFileDialog>
+#include <QtGui/QMessageBox>
 
 StreamlineGenerator::StreamlineGenerator(QString name,QWidget *parent):DockWidget(name,parent)
 {
@@ -21,6 +31,44 @@ StreamlineGenerator::StreamlineGenerator(QString name,QWidget *parent):DockWidge
 
          verticalLayout->addWidget(randomStreamlineSpinBox);
 
+         fieldLevelLabel = new QLabel(dockWidgetContents);
+         fieldLevelLabel->setObjectName(QString::fromUtf8("fieldLevelLabel"));
+
+         verticalLayout->addWidget(fieldLevelLabel);
+
+         fieldLevelSpinBox = new QSpinBox(dockWidgetContents);
+         fieldLevelSpinBox->setObjectName(QString::fromUtf8("fieldLevelSpinBox"));
+         fieldLevelSpinBox->setMinimum(0);
+         fieldLevelSpinBox->setMaximum(8);
+         fieldLevelSpinBox->setValue(0);
+
+         verticalLayout->addWidget(fieldLevelSpinBox);
+
+         integratorLabel = new QLabel(dockWidgetContents);
+         integratorLabel->setObjectName(QString::fromUtf8("integratorLabel"));
+
+         verticalLayout->addWidget(integratorLabel);
+
+         integratorComboBox = new QComboBox(dockWidgetContents);
+         integratorComboBox->setObjectName(QString::fromUtf8("integratorComboBox"));
+
+         verticalLayout->addWidget(integratorComboBox);
+
+         toleranceLabel = new QLabel(dockWidgetContents);
+         toleranceLabel->setObjectName(QString::fromUtf8("toleranceLabel"));
+
+         verticalLayout->addWidget(toleranceLabel);
+
+         toleranceSpinBox = new QDoubleSpinBox(dockWidgetContents);
+         toleranceSpinBox->setObjectName(QString::fromUtf8("toleranceSpinBox"));
+         toleranceSpinBox->setDecimals(5);
+         toleranceSpinBox->setMinimum(0.00001);
+         toleranceSpinBox->setMaximum(1.0);
+         toleranceSpinBox->setSingleStep(0.0001);
+         toleranceSpinBox->setValue(0.0001);
+
+         verticalLayout->addWidget(toleranceSpinBox);
+
          generateStreamlinePushButton = new QPushButton(dockWidgetContents);
          generateStreamlinePushButton->setObjectName(QString::fromUtf8("generateStreamlinePushButton"));
 
@@ -31,30 +79,349 @@ StreamlineGenerator::StreamlineGenerator(QString name,QWidget *parent):DockWidge
 
          verticalLayout->addWidget(clearStreamlinePushButton);
 
+         saveLinesPushButton = new QPushButton(dockWidgetContents);
+         saveLinesPushButton->setObjectName(QString::fromUtf8("saveLinesPushButton"));
+
+         verticalLayout->addWidget(saveLinesPushButton);
+
+         loadLinesPushButton = new QPushButton(dockWidgetContents);
+         loadLinesPushButton->setObjectName(QString::fromUtf8("loadLinesPushButton"));
+
+         verticalLayout->addWidget(loadLinesPushButton);
+
+         compareIntegratorsPushButton = new QPushButton(dockWidgetContents);
+         compareIntegratorsPushButton->setObjectName(QString::fromUtf8("compareIntegratorsPushButton"));
+
+         verticalLayout->addWidget(compareIntegratorsPushButton);
+
+         packetTracingCheckBox = new QCheckBox(dockWidgetContents);
+         packetTracingCheckBox->setObjectName(QString::fromUtf8("packetTracingCheckBox"));
+
+         verticalLayout->addWidget(packetTracingCheckBox);
+
+         benchmarkPacketsPushButton = new QPushButton(dockWidgetContents);
+         benchmarkPacketsPushButton->setObjectName(QString::fromUtf8("benchmarkPacketsPushButton"));
+
+         verticalLayout->addWidget(benchmarkPacketsPushButton);
+
+         benchmarkResamplingPushButton = new QPushButton(dockWidgetContents);
+         benchmarkResamplingPushButton->setObjectName(QString::fromUtf8("benchmarkResamplingPushButton"));
+
+         verticalLayout->addWidget(benchmarkResamplingPushButton);
+
+         pathlinesPushButton = new QPushButton(dockWidgetContents);
+         pathlinesPushButton->setObjectName(QString::fromUtf8("pathlinesPushButton"));
+
+         verticalLayout->addWidget(pathlinesPushButton);
+
+         streaklinesPushButton = new QPushButton(dockWidgetContents);
+         streaklinesPushButton->setObjectName(QString::fromUtf8("streaklinesPushButton"));
+
+         verticalLayout->addWidget(streaklinesPushButton);
+
+         separationLabel = new QLabel(dockWidgetContents);
+         separationLabel->setObjectName(QString::fromUtf8("separationLabel"));
+
+         verticalLayout->addWidget(separationLabel);
+
+         separationSpinBox = new QDoubleSpinBox(dockWidgetContents);
+         separationSpinBox->setObjectName(QString::fromUtf8("separationSpinBox"));
+         separationSpinBox->setMinimum(0.5);
+         separationSpinBox->setMaximum(32.0);
+         separationSpinBox->setSingleStep(0.5);
+         separationSpinBox->setValue(4.0);
+
+         verticalLayout->addWidget(separationSpinBox);
+
+         testDistanceLabel = new QLabel(dockWidgetContents);
+         testDistanceLabel->setObjectName(QString::fromUtf8("testDistanceLabel"));
+
+         verticalLayout->addWidget(testDistanceLabel);
+
+         testDistanceSpinBox = new QDoubleSpinBox(dockWidgetContents);
+         testDistanceSpinBox->setObjectName(QString::fromUtf8("testDistanceSpinBox"));
+         testDistanceSpinBox->setMinimum(0.25);
+         testDistanceSpinBox->setMaximum(32.0);
+         testDistanceSpinBox->setSingleStep(0.25);
+         testDistanceSpinBox->setValue(2.0);
+
+         verticalLayout->addWidget(testDistanceSpinBox);
+
+         evenlySpacedPushButton = new QPushButton(dockWidgetContents);
+         evenlySpacedPushButton->setObjectName(QString::fromUtf8("evenlySpacedPushButton"));
+
+         verticalLayout->addWidget(evenlySpacedPushButton);
+
+         //where the field lives and how the brick cache is doing, refreshed after every trace
+         storageLabel = new QLabel(dockWidgetContents);
+         storageLabel->setObjectName(QString::fromUtf8("storageLabel"));
+         storageLabel->setWordWrap(true);
+
+         verticalLayout->addWidget(storageLabel);
+
          verticalSpacer = new QSpacerItem(20, 40, QSizePolicy::Minimum, QSizePolicy::Expanding);
 
          verticalLayout->addItem(verticalSpacer);
         setWidget(dockWidgetContents);
 
          generateStreamLineLabel->setText(QApplication::translate("StreamlineGenerator", "New Streamline Number:", 0, QApplication::UnicodeUTF8));
+         fieldLevelLabel->setText(QApplication::translate("StreamlineGenerator", "Field Level (0 = full resolution):", 0, QApplication::UnicodeUTF8));
          generateStreamlinePushButton->setText(QApplication::translate("StreamlineGenerator", "Generate", 0, QApplication::UnicodeUTF8));
          clearStreamlinePushButton->setText(QApplication::translate("StreamlineGenerator", "Clear", 0, QApplication::UnicodeUTF8));
+         saveLinesPushButton->setText(QApplication::translate("StreamlineGenerator", "Save Lines...", 0, QApplication::UnicodeUTF8));
+         loadLinesPushButton->setText(QApplication::translate("StreamlineGenerator", "Load Lines...", 0, QApplication::UnicodeUTF8));
+         integratorLabel->setText(QApplication::translate("StreamlineGenerator", "Integrator:", 0, QApplication::UnicodeUTF8));
+         integratorComboBox->insertItems(0, QStringList()
+          << QApplication::translate("StreamlineGenerator", "RK4 (fixed step)", 0, QApplication::UnicodeUTF8)
+          << QApplication::translate("StreamlineGenerator", "Dormand-Prince 5(4) (adaptive)", 0, QApplication::UnicodeUTF8)
+         );
+         toleranceLabel->setText(QApplication::translate("StreamlineGenerator", "Tolerance (voxels per step):", 0, QApplication::UnicodeUTF8));
+         compareIntegratorsPushButton->setText(QApplication::translate("StreamlineGenerator", "Compare Integrators", 0, QApplication::UnicodeUTF8));
+         packetTracingCheckBox->setText(QApplication::translate("StreamlineGenerator", "Packet Tracing (8 lines per step, RK4)", 0, QApplication::UnicodeUTF8));
+         benchmarkPacketsPushButton->setText(QApplication::translate("StreamlineGenerator", "Benchmark Packet Tracing", 0, QApplication::UnicodeUTF8));
+         benchmarkResamplingPushButton->setText(QApplication::translate("StreamlineGenerator", "Benchmark Resampling", 0, QApplication::UnicodeUTF8));
+         pathlinesPushButton->setText(QApplication::translate("StreamlineGenerator", "Pathlines", 0, QApplication::UnicodeUTF8));
+         streaklinesPushButton->setText(QApplication::translate("StreamlineGenerator", "Streaklines", 0, QApplication::UnicodeUTF8));
+         separationLabel->setText(QApplication::translate("StreamlineGenerator", "Separation (voxels):", 0, QApplication::UnicodeUTF8));
+         testDistanceLabel->setText(QApplication::translate("StreamlineGenerator", "Test Distance (voxels):", 0, QApplication::UnicodeUTF8));
+         evenlySpacedPushButton->setText(QApplication::translate("StreamlineGenerator", "Evenly Spaced", 0, QApplication::UnicodeUTF8));
 
          QMetaObject::connectSlotsByName(this);
 
          connect(generateStreamlinePushButton,SIGNAL(clicked()),this,SLOT(onGenerate()));
          connect(clearStreamlinePushButton,SIGNAL(clicked()),this,SLOT(onClear()));
+         connect(saveLinesPushButton,SIGNAL(clicked()),this,SLOT(onSaveLines()));
+         connect(loadLinesPushButton,SIGNAL(clicked()),this,SLOT(onLoadLines()));
+         connect(compareIntegratorsPushButton,SIGNAL(clicked()),this,SLOT(onCompareIntegrators()));
+         connect(evenlySpacedPushButton,SIGNAL(clicked()),this,SLOT(onGenerateEvenlySpaced()));
+         connect(benchmarkPacketsPushButton,SIGNAL(clicked()),this,SLOT(onBenchmarkPackets()));
+         connect(benchmarkResamplingPushButton,SIGNAL(clicked()),this,SLOT(onBenchmarkResampling()));
+         connect(pathlinesPushButton,SIGNAL(clicked()),this,SLOT(onGeneratePathlines()));
+         connect(streaklinesPushButton,SIGNAL(clicked()),this,SLOT(onGenerateStreaklines()));
 }
 
 void StreamlineGenerator::onGenerate()
 {
-    for(int i=0;i<randomStreamlineSpinBox->value();++i)
+    //seeds are drawn up front on this thread, so the lines are the same as a serial run
+    std::vector<GGL::Point3f> seeds(randomStreamlineSpinBox->value());
+
+    for(size_t i=0;i<seeds.size();++i)
+        seeds[i]=Streamline::randomSeed();
+
+    applyIntegrator();
+
+    int level=selectedLevel();
+
+    QTime timer;
+    timer.start();
+
+    StreamlineStore &pool=Streamline::streamlinePool;
+    int first=pool.getLineCount();
+
+    StreamlineTracer tracer;
+    tracer.setPacketTracing(packetTracingCheckBox->isChecked());
+    tracer.trace(seeds,pool,level);
+
+    int elapsed=qMax(timer.elapsed(),1);
+
+    double samples=0.0;
+    double fetches=0.0;
+    double steps=0.0;
+
+    for(int i=first;i<pool.getLineCount();++i)
+    {
+        samples+=pool.getSampleCount(i);
+        fetches+=pool.getCellFetchCount(i);
+        steps+=qMax(pool.getLineSize(i)-1,1);
+    }
+
+    //every corner load reads 8 vectors of 12 bytes, without the cell cache each sample would
+    qDebug("%.1f samples/step, %.1f cell loads/step, %.0f corner bytes/step instead of %.0f",samples/steps,fetches/steps,fetches*96.0/steps,samples*96.0/steps);
+
+    qDebug("Traced %d lines in %d ms on %d threads, %.0f lines/s, %u steals",(int)seeds.size(),elapsed,tracer.getThreadCount(),seeds.size()*1000.0/elapsed,tracer.getSteals());
+    storageLabel->setText(VectorField::getSingleton().getStorageInfo());
+}
+
+void StreamlineGenerator::applyIntegrator()
+{
+    Streamline::setIntegrator((Streamline::Integrator)integratorComboBox->currentIndex(),(float)toleranceSpinBox->value());
+}
+
+int StreamlineGenerator::selectedLevel()
+{
+    int level=fieldLevelSpinBox->value();
+
+    VectorField::getSingleton().ensureLevels(level);
+
+    return level;
+}
+
+void StreamlineGenerator::onCompareIntegrators()
+{
+    //the same seeds through both integrators, nothing is added to the pool
+    std::vector<GGL::Point3f> seeds(randomStreamlineSpinBox->value());
+
+    for(size_t i=0;i<seeds.size();++i)
+        seeds[i]=Streamline::randomSeed();
+
+    const char *names[]={"RK4","DP5(4)"};
+
+    for(int i=0;i<2;++i)
+    {
+        Streamline::setIntegrator((Streamline::Integrator)i,(float)toleranceSpinBox->value());
+
+        StreamlineStore lines;
+        StreamlineTracer tracer;
+        tracer.trace(seeds,lines,selectedLevel());
+
+        double samples=0.0;
+        double length=0.0;
+        int count=lines.getLineCount();
+
+        for(int j=0;j<count;++j)
+        {
+            samples+=lines.getSampleCount(j);
+            length+=lines.getLength(j);
+        }
+
+        qDebug("%s: %.1f samples/line, %.1f points/line, %.1f voxels/line, %.1f samples per 100 voxels",names[i],
+               samples/count,(double)lines.getPointCount()/count,length/count,length>0.0?samples*100.0/length:0.0);
+    }
+
+    applyIntegrator();
+}
+
+void StreamlineGenerator::onGenerateEvenlySpaced()
+{
+    QTime timer;
+    timer.start();
+
+    //always RK4, the seeder stops each step against the placed lines
+    EvenlySpacedSeeder seeder((float)separationSpinBox->value(),(float)testDistanceSpinBox->value(),selectedLevel());
+    int placed=seeder.generate(Streamline::streamlinePool,randomStreamlineSpinBox->maximum());
+
+    qDebug("Placed %d evenly spaced lines in %d ms, %d samples including rejected lines",placed,timer.elapsed(),seeder.getSampleCount());
+}
+
+void StreamlineGenerator::onBenchmarkPackets()
+{
+    //the same seeds one line at a time and in packets, on one thread and on all cores, with RK4
+    std::vector<GGL::Point3f> seeds(randomStreamlineSpinBox->value());
+
+    for(size_t i=0;i<seeds.size();++i)
+        seeds[i]=Streamline::randomSeed();
+
+    int level=selectedLevel();
+
+    Streamline::setIntegrator(Streamline::ClassicRK4);
+
+    QTime timer;
+    timer.start();
+
+    for(size_t i=0;i<seeds.size();++i)
     {
-        Streamline sl;
-        sl.generateRandomly();
+        Streamline line;
+        line.generate(seeds[i],level);
+    }
+
+    double scalar=seeds.size()*1000.0/qMax(timer.elapsed(),1);
+
+    const char *names[]={"1 thread","all cores"};
+    double rates[2];
+
+    for(int i=0;i<2;++i)
+    {
+        StreamlineStore lines;
+        StreamlineTracer tracer(i==0?1:0);
+        tracer.setPacketTracing(true);
 
-        Streamline::streamlinePool.push_back(sl);
+        timer.restart();
+        tracer.trace(seeds,lines,level);
+        rates[i]=seeds.size()*1000.0/qMax(timer.elapsed(),1);
     }
+
+    qDebug("Streamline::generate: %.0f lines/s, packets on %s: %.0f lines/s (x%.2f), on %s: %.0f lines/s (x%.2f)",
+           scalar,names[0],rates[0],rates[0]/scalar,names[1],rates[1],rates[1]/scalar);
+
+    applyIntegrator();
+}
+
+void StreamlineGenerator::onBenchmarkResampling()
+{
+    //the lines in the pool to 49 samples and to a sample per voxel, on one thread and on all cores
+    const StreamlineStore &pool=Streamline::streamlinePool;
+
+    if(pool.getLineCount()==0)
+    {
+        qDebug("Generate or load lines to resample first");
+        return;
+    }
+
+    StreamlineResampler resamplers[2]={StreamlineResampler(StreamlineResampler::UniformCount,49),StreamlineResampler(StreamlineResampler::UniformSpacing,1.0f)};
+    const char *modes[]={"49 samples","1 voxel spacing"};
+
+    QTime timer;
+
+    for(int m=0;m<2;++m)
+    {
+        double rates[2];
+        int samples=0;
+
+        for(int i=0;i<2;++i)
+        {
+            StreamlineStore output;
+
+            timer.start();
+            resamplers[m].resample(pool,output,i==1);
+            rates[i]=pool.getLineCount()*1000.0/qMax(timer.elapsed(),1);
+            samples=output.getPointCount();
+        }
+
+        qDebug("Resampling %d lines, %d points to %s, %d samples: 1 thread %.0f lines/s, all cores %.0f lines/s (x%.2f)",
+               pool.getLineCount(),pool.getPointCount(),modes[m],samples,rates[0],rates[1],rates[1]/rates[0]);
+    }
+}
+
+void StreamlineGenerator::onGeneratePathlines()
+{
+    traceUnsteady(false);
+}
+
+void StreamlineGenerator::onGenerateStreaklines()
+{
+    traceUnsteady(true);
+}
+
+void StreamlineGenerator::traceUnsteady(bool streaklines)
+{
+    int steps=VectorField::getSingleton().getStepCount();
+
+    if(steps<2)
+    {
+        qDebug("Pathlines and streaklines need a time series, the loaded field has one step");
+        return;
+    }
+
+    std::vector<GGL::Point3f> seeds(randomStreamlineSpinBox->value());
+
+    for(size_t i=0;i<seeds.size();++i)
+        seeds[i]=Streamline::randomSeed();
+
+    QTime timer;
+    timer.start();
+
+    //over the whole series, one time unit per frame
+    UnsteadyTracer tracer;
+    int first=Streamline::streamlinePool.getLineCount();
+
+    if(streaklines)
+        tracer.traceStreaklines(seeds,0,steps-1,Streamline::streamlinePool);
+    else
+        tracer.tracePathlines(seeds,0,steps-1,Streamline::streamlinePool);
+
+    qDebug("%d %s through %u slabs in %d ms, %u particle steps",Streamline::streamlinePool.getLineCount()-first,streaklines?"streakline pieces":"pathlines",
+           tracer.getSlabCount(),timer.elapsed(),tracer.getParticleSteps());
+    storageLabel->setText(VectorField::getSingleton().getStorageInfo());
 }
 
 void StreamlineGenerator::onClear()
@@ -62,6 +429,76 @@ void StreamlineGenerator::onClear()
     Streamline::streamlinePool.clear();
 }
 
+void StreamlineGenerator::onSaveLines()
+{
+    StreamlineStore &pool=Streamline::streamlinePool;
+
+    if(pool.getLineCount()==0)
+        return;
+
+    QString fileName = QFileDialog::getSaveFileName(this,tr("Save Streamlines"), "./", tr("Streamline File (*.slf)"));
+
+    if(fileName.length()==0)
+        return;
+
+    QTime timer;
+    timer.start();
+
+    //the field magnitude goes along, so a viewer can color the lines without the field
+    VectorField &field=VectorField::getSingleton();
+    StreamlineWriter writer;
+    bool result=writer.open(fileName,StreamlineFile::QuantizedDelta,StreamlineFile::Magnitude);
+    std::vector<float> magnitudes;
+
+    for(int i=0;i<pool.getLineCount() && result;++i)
+    {
+        const GGL::Point3f *points=pool.getLine(i);
+        int count=pool.getLineSize(i);
+
+        magnitudes.resize(count);
+
+        for(int j=0;j<count;++j)
+            magnitudes[j]=field.getVector(points[j].X(),points[j].Y(),points[j].Z()).length();
+
+        writer.writeLine(points,count);
+        writer.writeAttribute(StreamlineFile::Magnitude,magnitudes.empty()?NULL:&magnitudes[0],count);
+    }
+
+    if(!writer.close())
+    {
+        QMessageBox msgBox;
+        msgBox.setText(QString("Cannot write %1").arg(fileName));
+        msgBox.exec();
+        return;
+    }
+
+    qDebug("Saved %d lines, %d points in %d ms, %lld bytes",pool.getLineCount(),pool.getPointCount(),timer.elapsed(),QFileInfo(fileName).size());
+}
+
+void StreamlineGenerator::onLoadLines()
+{
+    QString fileName = QFileDialog::getOpenFileName(this,tr("Load Streamlines"), "./", tr("Streamline File (*.slf)"));
+
+    if(fileName.length()==0)
+        return;
+
+    QTime timer;
+    timer.start();
+
+    //lines are added to the pool as generated ones are
+    StreamlineReader reader;
+
+    if(!reader.open(fileName) || !reader.readAll(Streamline::streamlinePool))
+    {
+        QMessageBox msgBox;
+        msgBox.setText(QString("Cannot read %1").arg(fileName));
+        msgBox.exec();
+        return;
+    }
+
+    qDebug("Loaded %d lines, %lld points in %d ms",reader.getLineCount(),reader.getPointCount(),timer.elapsed());
+}
+
 StreamlineGenerator::~StreamlineGenerator()
 {
 }
@@ -6,6 +6,9 @@
 #include <QtGui/QAction>
 #include <QtGui/QApplication>
 #include <QtGui/QButtonGroup>
+#include <QtGui/QCheckBox>
+#include <QtGui/QComboBox>
+#include <QtGui/QDoubleSpinBox>
 #include <QtGui/QDockWidget>
 #include <QtGui/QHeaderView>
 #include <QtGui/QLabel>
@@ -29,8 +32,28 @@ private:
       QVBoxLayout *verticalLayout;
       QLabel *generateStreamLineLabel;
       QSpinBox *randomStreamlineSpinBox;
+      QLabel *fieldLevelLabel;
+      QSpinBox *fieldLevelSpinBox;
+      QLabel *integratorLabel;
+      QComboBox *integratorComboBox;
+      QLabel *toleranceLabel;
+      QDoubleSpinBox *toleranceSpinBox;
+      QPushButton *compareIntegratorsPushButton;
+      QCheckBox *packetTracingCheckBox;
+      QPushButton *benchmarkPacketsPushButton;
+      QPushButton *benchmarkResamplingPushButton;
+      QPushButton *pathlinesPushButton;
+      QPushButton *streaklinesPushButton;
+      QLabel *separationLabel;
+      QDoubleSpinBox *separationSpinBox;
+      QLabel *testDistanceLabel;
+      QDoubleSpinBox *testDistanceSpinBox;
+      QPushButton *evenlySpacedPushButton;
       QPushButton *generateStreamlinePushButton;
       QPushButton *clearStreamlinePushButton;
+      QPushButton *saveLinesPushButton;
+      QPushButton *loadLinesPushButton;
+      QLabel *storageLabel;
       QSpacerItem *verticalSpacer;
 
 public:
@@ -39,7 +62,20 @@ public:
 
 private slots:
     void onGenerate();
+    void onCompareIntegrators();
+    void onGenerateEvenlySpaced();
+    void onBenchmarkPackets();
+    void onBenchmarkResampling();
+    void onGeneratePathlines();
+    void onGenerateStreaklines();
     void onClear();
+    void onSaveLines();
+    void onLoadLines();
+
+private:
+    void applyIntegrator();
+    int selectedLevel();
+    void traceUnsteady(bool streaklines);
 };
 
 #endif // STREAMLINEGENERATOR_H
@@ -0,0 +1,180 @@
+#include "streamlineresampler.h"
+#include <math.h>
+#include <algorithm>
+#include <QtCore/QVector>
+#include <QtCore/QtConcurrentMap>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+#define STREAMLINERESAMPLER_SSE
+#include <emmintrin.h>
+#endif
+
+//lines per task, enough to outweigh the merge of the per task stores
+static const int rangeSize=256;
+
+//Point a+(b-a)*t of segment i into out. The loads overlap: x,y,z of point i plus x of i+1, and z
+//of point i plus x,y,z of i+1, so neither reads past the end of the line. The store writes one
+//float past out, the caller only uses it where the next sample follows.
+static inline void lerpSegment(const GGL::Point3f *points,int i,float t,GGL::Point3f *out)
+{
+#ifdef STREAMLINERESAMPLER_SSE
+    __m128 a=_mm_loadu_ps(points[i].V());
+    __m128 b=_mm_loadu_ps(points[i].V()+2);
+    b=_mm_shuffle_ps(b,b,_MM_SHUFFLE(3,3,2,1));
+    _mm_storeu_ps(out->V(),_mm_add_ps(a,_mm_mul_ps(_mm_sub_ps(b,a),_mm_set1_ps(t))));
+#else
+    *out=points[i]+(points[i+1]-points[i])*t;
+#endif
+}
+
+StreamlineResampler::StreamlineResampler(Mode _mode,float parameter):mode(_mode)
+{
+    count=qMax(2,(int)parameter);
+    spacing=qMax(0.001f,parameter);
+}
+
+bool StreamlineResampler::resample(const GGL::Point3f *points,int pointCount,std::vector<GGL::Point3f> &samples) const
+{
+    std::vector<float> lengths;
+    return resample(points,pointCount,samples,lengths);
+}
+
+bool StreamlineResampler::resample(const GGL::Point3f *points,int pointCount,std::vector<GGL::Point3f> &samples,std::vector<float> &lengths) const
+{
+    if(pointCount<2)
+        return false;
+
+    //arc length at every point: squared segment lengths, their roots four at a time, then the sum
+    lengths.resize(pointCount);
+    lengths[0]=0.0f;
+
+    for(int i=1;i<pointCount;++i)
+    {
+        GGL::Point3f d=points[i]-points[i-1];
+        lengths[i]=d*d;
+    }
+
+    int i=1;
+
+#ifdef STREAMLINERESAMPLER_SSE
+    for(;i+4<=pointCount;i+=4)
+        _mm_storeu_ps(&lengths[i],_mm_sqrt_ps(_mm_loadu_ps(&lengths[i])));
+#endif
+
+    for(;i<pointCount;++i)
+        lengths[i]=sqrt(lengths[i]);
+
+    for(i=1;i<pointCount;++i)
+        lengths[i]+=lengths[i-1];
+
+    float total=lengths[pointCount-1];
+
+    if(!(total>0.0f))
+        return false;
+
+    //samples placed by interpolation, the end point may follow as its own sample
+    int placed;
+    bool closed;
+    float step;
+
+    if(mode==UniformCount)
+    {
+        placed=count-1;
+        closed=true;
+        step=total/(float)(count-1);
+    }
+    else
+    {
+        placed=(int)(total/spacing)+1;
+        closed=total-(placed-1)*spacing>0.01f*spacing;
+        step=spacing;
+    }
+
+    size_t first=samples.size();
+    samples.resize(first+placed+(closed?1:0));
+
+    GGL::Point3f *out=&samples[first];
+    const float *begin=&lengths[0];
+    const float *end=begin+pointCount;
+    int segment=0;
+
+    for(int k=0;k<placed;++k)
+    {
+        float target=step*(float)k;
+
+        //the first arc length past the target ends the segment, searched from the last segment on
+        segment=(int)(std::upper_bound(begin+segment+1,end,target)-begin)-1;
+        segment=qMin(segment,pointCount-2);
+
+        float span=lengths[segment+1]-lengths[segment];
+        float t=span>0.0f?qMin((target-lengths[segment])/span,1.0f):0.0f;
+
+        if(k+1<placed || closed)
+            lerpSegment(points,segment,t,out+k);
+        else
+            out[k]=points[segment]+(points[segment+1]-points[segment])*t;
+    }
+
+    if(closed)
+        out[placed]=points[pointCount-1];
+
+    return true;
+}
+
+void StreamlineResampler::resampleRange(LineRange &range)
+{
+    const StreamlineResampler &resampler=*range.resampler;
+    const StreamlineStore &input=*range.input;
+    std::vector<float> lengths;
+
+    for(int i=range.begin;i<range.end;++i)
+    {
+        const GGL::Point3f *points=input.getLineSize(i)?input.getLine(i):NULL;
+        int pointCount=input.getLineSize(i);
+
+        std::vector<GGL::Point3f> &samples=range.output.beginLine();
+
+        bool resampled=resampler.resample(points,pointCount,samples,lengths);
+
+        if(!resampled && pointCount>0)
+            samples.insert(samples.end(),resampler.mode==UniformCount?resampler.count:1,points[0]);
+
+        range.output.endLine(0,0);
+        range.resampled.push_back(resampled?1:0);
+    }
+}
+
+void StreamlineResampler::resample(const StreamlineStore &input,StreamlineStore &output,bool parallel,std::vector<char> *resampled) const
+{
+    int lineCount=input.getLineCount();
+
+    QVector<LineRange> ranges((lineCount+rangeSize-1)/rangeSize);
+
+    for(int i=0;i<ranges.size();++i)
+    {
+        ranges[i].resampler=this;
+        ranges[i].input=&input;
+        ranges[i].begin=i*rangeSize;
+        ranges[i].end=qMin(lineCount,(i+1)*rangeSize);
+    }
+
+    if(parallel)
+        QtConcurrent::blockingMap(ranges,&StreamlineResampler::resampleRange);
+    else
+        for(int i=0;i<ranges.size();++i)
+            resampleRange(ranges[i]);
+
+    int pointCount=output.getPointCount();
+
+    for(int i=0;i<ranges.size();++i)
+        pointCount+=ranges[i].output.getPointCount();
+
+    output.reserve(output.getLineCount()+lineCount,pointCount);
+
+    for(int i=0;i<ranges.size();++i)
+        output.append(ranges[i].output);
+
+    if(resampled)
+        for(int i=0;i<ranges.size();++i)
+            resampled->insert(resampled->end(),ranges[i].resampled.begin(),ranges[i].resampled.end());
+}
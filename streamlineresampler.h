@@ -0,0 +1,52 @@
+#ifndef STREAMLINERESAMPLER_H
+#define STREAMLINERESAMPLER_H
+
+#include <vector>
+#include "Point3.h"
+#include "streamlinestore.h"
+
+//Resamples polylines at equal arc length. The segment lengths of a line are summed into a prefix
+//array, every sample finds its segment by binary search in it from the segment of the sample
+//before and is interpolated there with x, y and z in one SSE register when available. Lines are
+//independent, so a whole store is resampled in chunks of lines on all cores.
+class StreamlineResampler
+{
+public:
+    enum Mode {UniformCount, UniformSpacing};
+
+private:
+    struct LineRange
+    {
+        const StreamlineResampler *resampler;
+        const StreamlineStore *input;
+        int begin;
+        int end;
+        StreamlineStore output;
+        std::vector<char> resampled;
+    };
+
+    Mode mode;
+    int count;
+    float spacing;
+
+    bool resample(const GGL::Point3f *points,int pointCount,std::vector<GGL::Point3f> &samples,std::vector<float> &lengths) const;
+
+    static void resampleRange(LineRange &range);
+
+public:
+    //UniformCount: parameter points from the first to the last point of every line.
+    //UniformSpacing: a point every parameter voxels from the first, then the last point unless the
+    //line ends within 1% of the spacing after the last sample.
+    StreamlineResampler(Mode _mode,float parameter);
+
+    //appends the samples of one line, false and nothing appended for a line with less than two
+    //points or no length
+    bool resample(const GGL::Point3f *points,int pointCount,std::vector<GGL::Point3f> &samples) const;
+
+    //Appends one line to output for every line of input, in the same order. A line that cannot be
+    //resampled gives its first point, count times in UniformCount mode, and a 0 in resampled when
+    //that is given, the others a 1. Without parallel the lines are done on the calling thread.
+    void resample(const StreamlineStore &input,StreamlineStore &output,bool parallel=true,std::vector<char> *resampled=NULL) const;
+};
+
+#endif // STREAMLINERESAMPLER_H
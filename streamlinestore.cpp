@@ -0,0 +1,104 @@
+#include <GL/glew.h>
+#include "streamlinestore.h"
+#include "vertexbuffer.h"
+
+StreamlineStore::StreamlineStore():lineStart(0),version(0)
+{
+}
+
+std::vector<GGL::Point3f> &StreamlineStore::beginLine()
+{
+    lineStart=(int)points.size();
+    return points;
+}
+
+void StreamlineStore::endLine(int _samples,int _cellFetches)
+{
+    firsts.push_back(lineStart);
+    counts.push_back((int)points.size()-lineStart);
+    samples.push_back(_samples);
+    cellFetches.push_back(_cellFetches);
+
+    lineStart=(int)points.size();
+    ++version;
+}
+
+void StreamlineStore::appendLine(const GGL::Point3f *linePoints,int count,int _samples,int _cellFetches)
+{
+    beginLine().insert(points.end(),linePoints,linePoints+count);
+    endLine(_samples,_cellFetches);
+}
+
+void StreamlineStore::appendLine(const StreamlineStore &other,int line)
+{
+    const GGL::Point3f *linePoints=other.points.empty()?(const GGL::Point3f *)0:other.getLine(line);
+
+    appendLine(linePoints,other.counts[line],other.samples[line],other.cellFetches[line]);
+}
+
+void StreamlineStore::append(const StreamlineStore &other)
+{
+    int base=(int)points.size();
+
+    points.insert(points.end(),other.points.begin(),other.points.end());
+    counts.insert(counts.end(),other.counts.begin(),other.counts.end());
+    samples.insert(samples.end(),other.samples.begin(),other.samples.end());
+    cellFetches.insert(cellFetches.end(),other.cellFetches.begin(),other.cellFetches.end());
+
+    for(size_t i=0;i<other.firsts.size();++i)
+        firsts.push_back(other.firsts[i]+base);
+
+    lineStart=(int)points.size();
+    ++version;
+}
+
+void StreamlineStore::clear()
+{
+    //trivially destructible elements, clearing only resets the sizes
+    points.clear();
+    firsts.clear();
+    counts.clear();
+    samples.clear();
+    cellFetches.clear();
+    lineStart=0;
+    ++version;
+}
+
+void StreamlineStore::reserve(int lineCount,int pointCount)
+{
+    points.reserve(pointCount);
+    firsts.reserve(lineCount);
+    counts.reserve(lineCount);
+    samples.reserve(lineCount);
+    cellFetches.reserve(lineCount);
+}
+
+float StreamlineStore::getLength(int line) const
+{
+    float length=0.0f;
+
+    for(int i=firsts[line]+1;i<firsts[line]+counts[line];++i)
+        length+=(points[i]-points[i-1]).length();
+
+    return length;
+}
+
+void StreamlineStore::draw(VertexBuffer &buffer) const
+{
+    if(firsts.empty())
+        return;
+
+    if(!buffer.isCurrent(version))
+        buffer.upload(version,getVertexData(),(int)(points.size()*sizeof(GGL::Point3f)));
+
+    glColor4ub(100, 0, 0,80);
+
+    buffer.bind();
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3,GL_FLOAT,sizeof(GGL::Point3f),bufferOffset(0));
+
+    glMultiDrawArrays(GL_LINE_STRIP,getFirsts(),getCounts(),(GLsizei)firsts.size());
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+    buffer.unbind();
+}
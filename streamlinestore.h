@@ -0,0 +1,97 @@
+#ifndef STREAMLINESTORE_H
+#define STREAMLINESTORE_H
+
+#include <vector>
+#include "Point3.h"
+
+class VertexBuffer;
+
+//Many streamlines in one flat point buffer. Line i is counts[i] points from firsts[i], so the
+//buffer uploads as one vertex buffer and firsts/counts are the arrays glMultiDrawArrays takes.
+//Lines are appended in place, tracers use one store per thread as an arena and merge them after.
+class StreamlineStore
+{
+    std::vector<GGL::Point3f> points;
+    std::vector<int> firsts;
+    std::vector<int> counts;
+    std::vector<int> samples;
+    std::vector<int> cellFetches;
+
+    int lineStart;
+
+    //bumped by every change, a vertex buffer holding an older version is uploaded again
+    unsigned int version;
+
+public:
+    StreamlineStore();
+
+    //the tracing kernels append straight to the returned buffer, endLine closes the line
+    std::vector<GGL::Point3f> &beginLine();
+    void endLine(int _samples,int _cellFetches);
+
+    void appendLine(const GGL::Point3f *linePoints,int count,int _samples,int _cellFetches);
+    void appendLine(const StreamlineStore &other,int line);
+    void append(const StreamlineStore &other);
+
+    //keeps the capacity, a store reused between batches does not allocate again
+    void clear();
+    void reserve(int lineCount,int pointCount);
+
+    float getLength(int line) const;
+
+    //all lines in one glMultiDrawArrays from buffer, which is refilled when the store changed
+    void draw(VertexBuffer &buffer) const;
+
+    unsigned int getVersion() const
+    {
+        return version;
+    };
+
+    int getLineCount() const
+    {
+        return (int)firsts.size();
+    };
+
+    int getPointCount() const
+    {
+        return (int)points.size();
+    };
+
+    const GGL::Point3f *getLine(int line) const
+    {
+        return &points[firsts[line]];
+    };
+
+    int getLineSize(int line) const
+    {
+        return counts[line];
+    };
+
+    int getSampleCount(int line) const
+    {
+        return samples[line];
+    };
+
+    int getCellFetchCount(int line) const
+    {
+        return cellFetches[line];
+    };
+
+    //vertex buffer contents, 3 floats per point
+    const float *getVertexData() const
+    {
+        return points.empty()?(const float *)0:points[0].V();
+    };
+
+    const int *getFirsts() const
+    {
+        return firsts.empty()?(const int *)0:&firsts[0];
+    };
+
+    const int *getCounts() const
+    {
+        return counts.empty()?(const int *)0:&counts[0];
+    };
+};
+
+#endif // STREAMLINESTORE_H
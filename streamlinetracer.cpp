@@ -0,0 +1,180 @@
+#include "streamlinetracer.h"
+#include "StreamLine.h"
+#include "packettracer.h"
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+#include <QtCore/QRunnable>
+
+class StreamlineTracer::Worker:public QRunnable
+{
+    StreamlineTracer *tracer;
+    int index;
+
+public:
+    Worker(StreamlineTracer *_tracer,int _index):tracer(_tracer),index(_index)
+    {
+        setAutoDelete(true);
+    }
+
+    void run()
+    {
+        tracer->traceRange(index);
+    }
+};
+
+//a packet refills its lanes from the worker's own range and steals like the scalar loop
+class StreamlineTracer::WorkerSeeds:public PacketTracer::SeedSource
+{
+    StreamlineTracer *tracer;
+    int index;
+
+public:
+    WorkerSeeds(StreamlineTracer *_tracer,int _index):tracer(_tracer),index(_index)
+    {
+    }
+
+    bool next(int &seed)
+    {
+        return tracer->takeSeed(index,seed) || tracer->stealSeeds(index,seed);
+    }
+};
+
+StreamlineTracer::StreamlineTracer(int _threadCount):seeds(NULL),level(0),threadCount(_threadCount),packetTracing(false),ranges(NULL),steals(0)
+{
+    if(threadCount<=0)
+        threadCount=qMax(1,QThread::idealThreadCount());
+}
+
+bool StreamlineTracer::takeSeed(int worker,int &seed)
+{
+    SeedRange &range=ranges[worker];
+    QMutexLocker locker(&range.mutex);
+
+    if(range.begin>=range.end)
+        return false;
+
+    seed=range.begin++;
+
+    return true;
+}
+
+bool StreamlineTracer::stealSeeds(int worker,int &seed)
+{
+    //victims are visited round robin from the next worker, so thieves spread over the ranges
+    for(int i=1;i<threadCount;++i)
+    {
+        SeedRange &victim=ranges[(worker+i)%threadCount];
+
+        int begin,end;
+
+        {
+            QMutexLocker locker(&victim.mutex);
+
+            int left=victim.end-victim.begin;
+
+            if(left<=0)
+                continue;
+
+            //the victim keeps the front half, with one seed left it is taken whole
+            begin=victim.end-(left+1)/2;
+            end=victim.end;
+            victim.end=begin;
+        }
+
+        seed=begin;
+
+        SeedRange &own=ranges[worker];
+        QMutexLocker locker(&own.mutex);
+        own.begin=begin+1;
+        own.end=end;
+
+        QMutexLocker statsLocker(&statsMutex);
+        ++steals;
+
+        return true;
+    }
+
+    return false;
+}
+
+void StreamlineTracer::traceRange(int worker)
+{
+    TracedLines &out=traced[worker];
+    int seed;
+
+    if(packetTracing && Streamline::getIntegrator()==Streamline::ClassicRK4)
+    {
+        PacketTracer packet(*seeds,level);
+        WorkerSeeds source(this,worker);
+        packet.run(source,out.lines,out.seeds);
+        return;
+    }
+
+    //no seeds are ever added, so once every range is empty the batch is done
+    while(takeSeed(worker,seed) || stealSeeds(worker,seed))
+    {
+        GGL::Point3f start=(*seeds)[seed];
+
+        out.seeds.push_back(seed);
+        Streamline::trace(start,level,out.lines);
+    }
+}
+
+void StreamlineTracer::trace(const std::vector<GGL::Point3f> &_seeds,StreamlineStore &output,int _level)
+{
+    int seedCount=(int)_seeds.size();
+
+    if(seedCount==0)
+        return;
+
+    seeds=&_seeds;
+    level=_level;
+    steals=0;
+
+    int workers=qMin(threadCount,seedCount);
+
+    ranges=new SeedRange[threadCount];
+    traced.assign(threadCount,TracedLines());
+
+    for(int i=0;i<threadCount;++i)
+    {
+        ranges[i].begin=i<workers?(int)((qint64)seedCount*i/workers):seedCount;
+        ranges[i].end=i<workers?(int)((qint64)seedCount*(i+1)/workers):seedCount;
+    }
+
+    //a private pool, the global one also runs the brick and frame prefetches
+    QThreadPool pool;
+    pool.setMaxThreadCount(workers);
+
+    for(int i=0;i<workers;++i)
+        pool.start(new Worker(this,i));
+
+    pool.waitForDone();
+
+    //merge by seed index, whichever worker traced a line
+    std::vector<int> mergedWorker(seedCount);
+    std::vector<int> mergedLine(seedCount);
+    int pointCount=output.getPointCount();
+
+    for(int i=0;i<workers;++i)
+    {
+        for(size_t j=0;j<traced[i].seeds.size();++j)
+        {
+            mergedWorker[traced[i].seeds[j]]=i;
+            mergedLine[traced[i].seeds[j]]=(int)j;
+        }
+
+        pointCount+=traced[i].lines.getPointCount();
+    }
+
+    output.reserve(output.getLineCount()+seedCount,pointCount);
+
+    for(int i=0;i<seedCount;++i)
+        output.appendLine(traced[mergedWorker[i]].lines,mergedLine[i]);
+
+    traced.clear();
+
+    delete [] ranges;
+    ranges=NULL;
+    seeds=NULL;
+}
@@ -0,0 +1,71 @@
+#ifndef STREAMLINETRACER_H
+#define STREAMLINETRACER_H
+
+#include <vector>
+#include <QtCore/QMutex>
+#include "Point3.h"
+#include "streamlinestore.h"
+
+//Traces a batch of seeds on all cores. Every worker owns a contiguous range of seeds and takes
+//from its front, a worker that runs dry steals the back half of another worker's range. Lines
+//go into a per worker store used as an append arena and are merged in seed order, so the output
+//does not depend on the scheduling and matches a serial trace of the same seeds.
+class StreamlineTracer
+{
+    struct SeedRange
+    {
+        QMutex mutex;
+        int begin;
+        int end;
+    };
+
+    struct TracedLines
+    {
+        std::vector<int> seeds;
+        StreamlineStore lines;
+    };
+
+    class Worker;
+    class WorkerSeeds;
+
+    const std::vector<GGL::Point3f> *seeds;
+    int level;
+    int threadCount;
+    bool packetTracing;
+
+    SeedRange *ranges;
+    std::vector<TracedLines> traced;
+
+    QMutex statsMutex;
+    unsigned int steals;
+
+    bool takeSeed(int worker,int &seed);
+    bool stealSeeds(int worker,int &seed);
+    void traceRange(int worker);
+
+public:
+    //threads<=0 uses one worker per core
+    StreamlineTracer(int _threadCount=0);
+
+    //appends one line per seed to output, in seed order
+    void trace(const std::vector<GGL::Point3f> &_seeds,StreamlineStore &output,int _level=0);
+
+    //workers advance PacketTracer::laneCount lines at once, only with the ClassicRK4 integrator,
+    //with DormandPrince54 every line is traced on its own as before
+    void setPacketTracing(bool enabled)
+    {
+        packetTracing=enabled;
+    };
+
+    unsigned int getSteals()
+    {
+        return steals;
+    };
+
+    int getThreadCount()
+    {
+        return threadCount;
+    };
+};
+
+#endif // STREAMLINETRACER_H
@@ -0,0 +1,223 @@
+#include "unsteadytracer.h"
+#include "VectorField.h"
+#include <QtCore/QtConcurrentMap>
+
+//particles advanced by one task
+static const int batchSize=1024;
+
+//the two frames around a slab, pinned once and sampled like getVectorAtTime with t=frame+s
+struct SlabSampler
+{
+    const VectorField *field;
+    const float *from;
+    const float *to;
+    int xSize;
+    int ySize;
+    int zSize;
+
+    GGL::Point3f operator()(const GGL::Point3f &p,float s) const
+    {
+        return field->getVectorBetweenFrames(from,to,p.X(),p.Y(),p.Z(),s);
+    };
+
+    bool inside(const GGL::Point3f &p) const
+    {
+        return p.X()>=0.0f && p.X()<=(float)(xSize-1) && p.Y()>=0.0f && p.Y()<=(float)(ySize-1) && p.Z()>=0.0f && p.Z()<=(float)(zSize-1);
+    };
+};
+
+//one RK4 step through space-time for a range of particles, s is the slab time at its start
+struct ParticleBatch
+{
+    const SlabSampler *sampler;
+    UnsteadyTracer::Particles *particles;
+    int begin;
+    int end;
+    float s;
+    float ds;
+    float h;
+    //pathline particles also stop where the flow stops, streak particles only leaving the field
+    bool stopWhenStalled;
+};
+
+static void advanceBatch(ParticleBatch &batch)
+{
+    const SlabSampler &sampler=*batch.sampler;
+    UnsteadyTracer::Particles &particles=*batch.particles;
+
+    float h=batch.h;
+    float middle=batch.s+0.5f*batch.ds;
+    float last=batch.s+batch.ds;
+
+    for(int i=batch.begin;i<batch.end;++i)
+    {
+        if(!particles.alive[i])
+            continue;
+
+        GGL::Point3f p=particles.positions[i];
+
+        GGL::Point3f k1=sampler(p,batch.s)*h;
+        GGL::Point3f k2=sampler(p+k1*0.5f,middle)*h;
+        GGL::Point3f k3=sampler(p+k2*0.5f,middle)*h;
+        GGL::Point3f k4=sampler(p+k3,last)*h;
+
+        GGL::Point3f next=p+(k1+k2*2.0f+k3*2.0f+k4)*(1.0f/6.0f);
+
+        if(!sampler.inside(next) || (batch.stopWhenStalled && (next-p).length()<0.00001f))
+            particles.alive[i]=0;
+        else
+            particles.positions[i]=next;
+    }
+}
+
+UnsteadyTracer::UnsteadyTracer(float _frameTime,int _substeps):frameTime(_frameTime),substeps(qMax(1,_substeps)),slabs(0),particleSteps(0)
+{
+}
+
+void UnsteadyTracer::sweep(const std::vector<GGL::Point3f> &seeds,int firstFrame,int lastFrame,bool streaks,Particles &particles,std::vector<std::vector<GGL::Point3f> > &lines)
+{
+    VectorField &field=VectorField::getSingleton();
+
+    SlabSampler sampler;
+    sampler.field=&field;
+    sampler.xSize=field.xSize;
+    sampler.ySize=field.ySize;
+    sampler.zSize=field.zSize;
+
+    int seedCount=(int)seeds.size();
+
+    if(!streaks)
+    {
+        particles.positions=seeds;
+        particles.owners.resize(seedCount);
+        particles.alive.assign(seedCount,1);
+        lines.assign(seedCount,std::vector<GGL::Point3f>());
+
+        for(int i=0;i<seedCount;++i)
+        {
+            particles.owners[i]=i;
+            lines[i].push_back(seeds[i]);
+        }
+    }
+
+    std::vector<ParticleBatch> batches;
+
+    for(int frame=firstFrame;frame<lastFrame;++frame)
+    {
+        //the whole slab reads from these two, the ring fetches the frames after them meanwhile
+        sampler.from=field.acquireFrame(frame);
+        sampler.to=field.acquireFrame(frame+1);
+
+        for(int step=0;step<substeps;++step)
+        {
+            if(streaks)
+            {
+                for(int i=0;i<seedCount;++i)
+                {
+                    particles.positions.push_back(seeds[i]);
+                    particles.owners.push_back(i);
+                    particles.alive.push_back(sampler.inside(seeds[i]));
+                }
+            }
+
+            int count=(int)particles.positions.size();
+
+            batches.clear();
+
+            for(int begin=0;begin<count;begin+=batchSize)
+            {
+                ParticleBatch batch;
+                batch.sampler=&sampler;
+                batch.particles=&particles;
+                batch.begin=begin;
+                batch.end=qMin(begin+batchSize,count);
+                batch.s=(float)step/substeps;
+                batch.ds=1.0f/substeps;
+                batch.h=frameTime/substeps;
+                batch.stopWhenStalled=!streaks;
+                batches.push_back(batch);
+            }
+
+            QtConcurrent::blockingMap(batches,advanceBatch);
+
+            particleSteps+=count;
+
+            if(!streaks)
+                for(int i=0;i<count;++i)
+                    if(particles.alive[i])
+                        lines[i].push_back(particles.positions[i]);
+        }
+
+        field.releaseFrame(frame);
+        field.releaseFrame(frame+1);
+
+        ++slabs;
+    }
+}
+
+bool UnsteadyTracer::tracePathlines(const std::vector<GGL::Point3f> &seeds,int firstFrame,int lastFrame,StreamlineStore &output)
+{
+    VectorField &field=VectorField::getSingleton();
+
+    lastFrame=qMin(lastFrame,field.getStepCount()-1);
+
+    if(field.getStepCount()<2 || firstFrame<0 || firstFrame>=lastFrame)
+        return false;
+
+    Particles particles;
+    std::vector<std::vector<GGL::Point3f> > lines;
+
+    sweep(seeds,firstFrame,lastFrame,false,particles,lines);
+
+    for(size_t i=0;i<lines.size();++i)
+        output.appendLine(&lines[i][0],(int)lines[i].size(),0,0);
+
+    return true;
+}
+
+bool UnsteadyTracer::traceStreaklines(const std::vector<GGL::Point3f> &seeds,int firstFrame,int lastFrame,StreamlineStore &output)
+{
+    VectorField &field=VectorField::getSingleton();
+
+    lastFrame=qMin(lastFrame,field.getStepCount()-1);
+
+    if(field.getStepCount()<2 || firstFrame<0 || firstFrame>=lastFrame)
+        return false;
+
+    Particles particles;
+    std::vector<std::vector<GGL::Point3f> > lines;
+
+    sweep(seeds,firstFrame,lastFrame,true,particles,lines);
+
+    //particles were released seed after seed, so seed i's are every seedCount-th from i
+    int seedCount=(int)seeds.size();
+    int count=(int)particles.positions.size();
+
+    std::vector<GGL::Point3f> points;
+
+    for(int i=0;i<seedCount;++i)
+    {
+        points.clear();
+        points.push_back(seeds[i]);
+
+        //newest first, a dead particle closes the piece so far
+        for(int j=count-seedCount+i;j>=0;j-=seedCount)
+        {
+            if(particles.alive[j])
+            {
+                points.push_back(particles.positions[j]);
+                continue;
+            }
+
+            if(points.size()>1)
+                output.appendLine(&points[0],(int)points.size(),0,0);
+
+            points.clear();
+        }
+
+        if(points.size()>1)
+            output.appendLine(&points[0],(int)points.size(),0,0);
+    }
+
+    return true;
+}
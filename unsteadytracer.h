@@ -0,0 +1,55 @@
+#ifndef UNSTEADYTRACER_H
+#define UNSTEADYTRACER_H
+
+#include <vector>
+#include "Point3.h"
+#include "streamlinestore.h"
+
+//Pathlines and streaklines of a time series. Time is swept one slab, the span between two
+//consecutive frames, at a time: both frames are pinned once and every particle is advanced through
+//the slab before the next one, so each frame is read once however many particles there are. Within
+//a slab the field is interpolated linearly in time, as getVectorAtTime does, and particles take
+//substeps RK4 steps through space-time, in parallel batches.
+class UnsteadyTracer
+{
+public:
+    struct Particles
+    {
+        std::vector<GGL::Point3f> positions;
+        std::vector<int> owners;
+        std::vector<char> alive;
+    };
+
+private:
+    float frameTime;
+    int substeps;
+
+    unsigned int slabs;
+    unsigned int particleSteps;
+
+    void sweep(const std::vector<GGL::Point3f> &seeds,int firstFrame,int lastFrame,bool streaks,Particles &particles,std::vector<std::vector<GGL::Point3f> > &lines);
+
+public:
+    //frameTime is the time between two frames in the units of the field's vectors
+    UnsteadyTracer(float _frameTime=1.0f,int _substeps=4);
+
+    //one line per seed, released at firstFrame and followed until lastFrame or until it leaves the
+    //field or stops. False without a time series.
+    bool tracePathlines(const std::vector<GGL::Point3f> &seeds,int firstFrame,int lastFrame,StreamlineStore &output);
+
+    //every seed releases a particle each substep from firstFrame on, the streakline is where those
+    //particles are at lastFrame, from the seed to the oldest. Particles that left the field split it.
+    bool traceStreaklines(const std::vector<GGL::Point3f> &seeds,int firstFrame,int lastFrame,StreamlineStore &output);
+
+    unsigned int getSlabCount()
+    {
+        return slabs;
+    };
+
+    unsigned int getParticleSteps()
+    {
+        return particleSteps;
+    };
+};
+
+#endif // UNSTEADYTRACER_H
@@ -0,0 +1,45 @@
+#include <GL/glew.h>
+#include "vertexbuffer.h"
+
+VertexBuffer::VertexBuffer():vertexName(0),indexName(0),uploaded(false),version(0)
+{
+}
+
+void VertexBuffer::upload(unsigned int _version,const void *vertices,int vertexBytes,const void *indices,int indexBytes)
+{
+    if(!vertexName)
+        glGenBuffers(1,&vertexName);
+
+    glBindBuffer(GL_ARRAY_BUFFER,vertexName);
+    glBufferData(GL_ARRAY_BUFFER,vertexBytes,vertices,GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER,0);
+
+    if(indexBytes)
+    {
+        if(!indexName)
+            glGenBuffers(1,&indexName);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,indexName);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER,indexBytes,indices,GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
+    }
+
+    uploaded=true;
+    version=_version;
+}
+
+void VertexBuffer::bind() const
+{
+    glBindBuffer(GL_ARRAY_BUFFER,vertexName);
+
+    if(indexName)
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,indexName);
+}
+
+void VertexBuffer::unbind() const
+{
+    glBindBuffer(GL_ARRAY_BUFFER,0);
+
+    if(indexName)
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
+}
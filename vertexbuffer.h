@@ -0,0 +1,40 @@
+#ifndef VERTEXBUFFER_H
+#define VERTEXBUFFER_H
+
+//A vertex buffer object, plus an optional index buffer, refilled only when the owner's data
+//changes. Owners bump a version number on every change and upload when isCurrent says the GPU
+//copy is stale, so a frame only binds and draws. GL names are created on the first upload,
+//which has to happen with the view's context current, and are freed with that context.
+class VertexBuffer
+{
+    unsigned int vertexName;
+    unsigned int indexName;
+
+    bool uploaded;
+    unsigned int version;
+
+    VertexBuffer(const VertexBuffer &);
+    void operator=(const VertexBuffer &);
+
+public:
+    VertexBuffer();
+
+    bool isCurrent(unsigned int _version) const
+    {
+        return uploaded && version==_version;
+    };
+
+    void upload(unsigned int _version,const void *vertices,int vertexBytes,const void *indices=0,int indexBytes=0);
+
+    //binds the buffers, gl*Pointer and glDrawElements then take byte offsets into them
+    void bind() const;
+    void unbind() const;
+};
+
+//byte offset into a bound buffer, in the form gl*Pointer expects
+inline const void *bufferOffset(int bytes)
+{
+    return (const char *)0+bytes;
+}
+
+#endif // VERTEXBUFFER_H